@@ -0,0 +1,167 @@
+#include "Camera.h"
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "VI.h"
+
+#ifdef __linux__
+
+struct CameraScenario {
+    const char* name;
+    int width;
+    int height;
+    int fps;
+    double jitterMs;
+    int cameras;
+    bool listener;  // onFrame delivery instead of a waitForFrame loop
+    bool reads;     // consumers read the frames, a listener that does not must still be called once per frame
+};
+
+struct ConsumerResult {
+    bool pattern = true;  // frames carry the generated pattern
+    int64_t frames = 0;
+    int64_t torn = 0;
+    Samples convertMs;
+    Samples latencyMs;  // listener consumers only, waiting ones report the Camera's histogram
+    VI::LatencyHistogram delivery;
+};
+
+// The generated pattern stores the frame index in blue at x = 0 and four times it in red, on every row.
+static bool PatternComplete(const unsigned char* bgr, int width, int height) {
+    for (int y : {0, height / 2, height - 1}) {
+        const unsigned char* pixel = bgr + (size_t)y * width * 3;
+        if ((unsigned char)(pixel[0] * 4) != pixel[2] || pixel[0] != bgr[0]) return false;
+    }
+    return true;
+}
+
+static void Consume(VI::Camera& camera, std::vector<unsigned char>& pixels, ConsumerResult& result) {
+    double start = NowMs();
+    if (!camera.getPixels(pixels.data(), false, false, false)) return;
+    result.convertMs.add(NowMs() - start);
+    result.frames++;
+    if (result.pattern) result.torn += !PatternComplete(pixels.data(), camera.getWidth(), camera.getHeight());
+}
+
+struct BenchListener : public VI::CameraListener {
+    std::vector<unsigned char>* pixels;
+    ConsumerResult* result;
+    bool reads;
+    void onFrame(VI::Camera& camera, int64_t latencyNs) override {
+        result->latencyMs.add(latencyNs / 1e6);
+        if (reads) {
+            Consume(camera, *pixels, *result);
+        } else {
+            result->frames++;
+        }
+    }
+};
+
+// Opens scenario.cameras Cameras on one device and consumes for the given time, one JSON object per run.
+// Hardware devices have no pattern to check, their size comes from the Camera.
+static int RunScenario(Json& json, const CameraScenario& scenario, int deviceID, double seconds, bool pattern) {
+    std::vector<std::unique_ptr<VI::Camera>> cameras;
+    for (int i = 0; i < scenario.cameras; i++) cameras.emplace_back(new VI::Camera(deviceID, scenario.width, scenario.height, scenario.fps));
+    int width = cameras[0]->getWidth(), height = cameras[0]->getHeight();
+    std::vector<std::vector<unsigned char>> pixels(scenario.cameras, std::vector<unsigned char>((size_t)width * height * 3));
+    std::vector<ConsumerResult> results(scenario.cameras);
+    std::vector<BenchListener> listeners(scenario.cameras);
+
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> consumers;
+    for (int i = 0; i < scenario.cameras; i++) {
+        results[i].pattern = pattern;
+        if (scenario.listener) {
+            listeners[i].pixels = &pixels[i];
+            listeners[i].result = &results[i];
+            listeners[i].reads = scenario.reads;
+            cameras[i]->setFrameListener(&listeners[i]);
+        } else {
+            consumers.emplace_back([&, i]() {
+                while (!stop) {
+                    if (cameras[i]->waitForFrame(100)) Consume(*cameras[i], pixels[i], results[i]);
+                }
+            });
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds((int)(seconds * 1000)));
+    stop = true;
+    for (auto& consumer : consumers) consumer.join();
+    for (int i = 0; i < scenario.cameras; i++) {
+        cameras[i]->setFrameListener(nullptr);
+        results[i].delivery = cameras[i]->getDeliveryLatency();
+    }
+
+    // more calls than the virtual camera published means the listener was woken again for a frame it already
+    // got; hardware may run faster than requested
+    int64_t expected = (int64_t)(seconds * scenario.fps);
+    int failures = 0;
+    json.beginObject();
+    json.value("name", scenario.name);
+    json.value("width", width);
+    json.value("height", height);
+    json.value("fps", scenario.fps);
+    json.value("jitter_ms", scenario.jitterMs);
+    json.value("expected_frames", expected);
+    json.beginArray("cameras");
+    for (int i = 0; i < scenario.cameras; i++) {
+        const ConsumerResult& result = results[i];
+        json.beginObject();
+        json.value("frames", result.frames);
+        json.value("torn", result.torn);
+        json.samples("convert_ms", result.convertMs);
+        if (scenario.listener) json.samples("latency_ms", result.latencyMs);
+        json.value("delivery_mean_ms", result.delivery.count ? result.delivery.totalNs / 1e6 / result.delivery.count : 0.0);
+        json.value("delivery_max_ms", result.delivery.maxNs / 1e6);
+        json.endObject();
+        fprintf(stderr, "camera: %s #%d, %lld frames, %lld torn, delivery mean %.3f ms max %.3f ms\n", scenario.name, i, (long long)result.frames, (long long)result.torn,
+                result.delivery.count ? result.delivery.totalNs / 1e6 / result.delivery.count : 0.0, result.delivery.maxNs / 1e6);
+        failures += result.torn > 0 || result.frames == 0 || (pattern && result.frames > expected + expected / 5 + 2);
+    }
+    json.endArray();
+    json.endObject();
+    return failures;
+}
+
+int RunCamera(Json& json, bool quick) {
+    const double seconds = quick ? 1.0 : 5.0;
+    const CameraScenario scenarios[] = {
+        {"vga30_wait", 640, 480, 30, 1.0, 1, false, true},
+        {"vga30_listener_idle", 640, 480, 30, 1.0, 1, true, false},
+        {"hd60_listener", 1920, 1080, 60, 2.0, 1, true, true},
+        {"hd30_x4_wait", 1920, 1080, 30, 2.0, 4, false, true},
+        {"hd30_x4_listener", 1920, 1080, 30, 2.0, 4, true, true},
+    };
+    int failures = 0;
+    json.beginArray("camera");
+    // V4L2 devices present (vivid, v4l2loopback or real cameras), virtual ones have their own ID range
+    VI::Array<VI::String> devices = VI::Camera::getDevices();
+    for (int deviceID = 0; deviceID < (int)devices.size(); deviceID++) {
+        std::string name = "v4l2_" + std::string(devices[deviceID].data(), devices[deviceID].size());
+        CameraScenario scenario = {name.c_str(), 640, 480, 30, 0, 1, false, true};
+        failures += RunScenario(json, scenario, deviceID, seconds, false);
+    }
+    for (const CameraScenario& scenario : scenarios) {
+        VI::VirtualCameraParams params;
+        params.width = scenario.width;
+        params.height = scenario.height;
+        params.fps = scenario.fps;
+        params.jitterMs = scenario.jitterMs;
+        failures += RunScenario(json, scenario, VI::Camera::addVirtualDevice(VI::String(scenario.name), params), seconds, true);
+    }
+    json.endArray();
+    return failures ? 1 : 0;
+}
+
+#else
+
+int RunCamera(Json& json, bool quick) {
+    fprintf(stderr, "--camera needs the virtual camera backend, which is Linux only\n");
+    return 1;
+}
+
+#endif
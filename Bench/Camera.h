@@ -0,0 +1,7 @@
+#pragma once
+#include "Report.h"
+
+// Capture -> convert -> consume through VI::Camera on every V4L2 device present (vivid, v4l2loopback) and
+// on virtual devices (generated patterns with jitter), with waiting and listener consumers and several
+// cameras at once. Returns non-zero on a torn frame or a camera that delivered nothing. Linux only.
+int RunCamera(Json& json, bool quick);
@@ -0,0 +1,88 @@
+#include "Handoff.h"
+#include "triple_buffer.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+
+static const size_t FrameBytes = 64 * 1024;
+
+struct HandoffResult {
+    uint64_t published = 0;
+    uint64_t consumed = 0;
+    uint64_t torn = 0;
+    uint64_t outOfOrder = 0;
+    Samples publishUs;  // time spent in the producer per frame, copy included
+    Samples latencyUs;  // publish to pick-up
+};
+
+// The payload repeats the low byte of the sequence, a frame mixing two writes shows up as torn.
+static void RunScenario(HandoffResult& result, double seconds, int consumerDelayUs) {
+    TripleBuffer<std::vector<uint8_t>> frames;
+    for (int i = 0; i < 3; i++) frames.slot(i).value.resize(FrameBytes);
+    std::atomic<bool> stop{false};
+
+    std::thread producer([&]() {
+        uint64_t sequence = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            int64_t start = TripleBuffer<int>::Now();
+            sequence++;
+            std::vector<uint8_t>& data = frames.back().value;
+            memset(data.data(), (int)(sequence & 0xff), data.size());
+            memcpy(data.data(), &sequence, sizeof(sequence));
+            frames.publish();
+            int64_t end = TripleBuffer<int>::Now();
+            // sampled, keeping every publish would dominate the run
+            if ((sequence & 63) == 0) result.publishUs.add((end - start) / 1000.0);
+        }
+        result.published = sequence;
+    });
+
+    uint64_t last = 0;
+    double deadline = NowMs() + seconds * 1000;
+    while (NowMs() < deadline) {
+        if (!frames.update()) {
+            std::this_thread::yield();
+            continue;
+        }
+        auto& slot = frames.front();
+        int64_t now = TripleBuffer<int>::Now();
+        uint64_t stored;
+        memcpy(&stored, slot.value.data(), sizeof(stored));
+        bool complete = stored == slot.sequence;
+        for (size_t i = sizeof(stored); complete && i < slot.value.size(); i++) complete = slot.value[i] == (uint8_t)(stored & 0xff);
+        result.torn += !complete;
+        result.outOfOrder += slot.sequence <= last;
+        last = slot.sequence;
+        result.consumed++;
+        result.latencyUs.add((now - slot.timestampNs) / 1000.0);
+        if (consumerDelayUs) std::this_thread::sleep_for(std::chrono::microseconds(consumerDelayUs));
+    }
+    stop = true;
+    producer.join();
+}
+
+int RunHandoff(Json& json, bool quick) {
+    double seconds = quick ? 0.5 : 3.0;
+    int failures = 0;
+    json.beginArray("handoff");
+    // a spinning consumer, one slower than the producer, and one far slower (a stalled UI thread)
+    for (int delayUs : {0, 1000, 20000}) {
+        HandoffResult result;
+        RunScenario(result, seconds, delayUs);
+        json.beginObject();
+        json.value("consumer_delay_us", delayUs);
+        json.value("frame_bytes", (int64_t)FrameBytes);
+        json.value("published", (int64_t)result.published);
+        json.value("consumed", (int64_t)result.consumed);
+        json.value("torn", (int64_t)result.torn);
+        json.value("out_of_order", (int64_t)result.outOfOrder);
+        json.samples("publish_us", result.publishUs);
+        json.samples("latency_us", result.latencyUs);
+        json.endObject();
+        fprintf(stderr, "handoff: consumer delay %d us, %llu published, %llu consumed, %llu torn, %llu out of order\n", delayUs, (unsigned long long)result.published, (unsigned long long)result.consumed, (unsigned long long)result.torn, (unsigned long long)result.outOfOrder);
+        failures += result.torn || result.outOfOrder;
+    }
+    json.endArray();
+    return failures ? 1 : 0;
+}
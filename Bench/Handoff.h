@@ -0,0 +1,7 @@
+#pragma once
+#include "Report.h"
+
+// Stress test of the camera frame handoff (TripleBuffer): a producer publishes as fast as it can while
+// consumers of different speeds check that every frame they take is complete and newer than the last.
+// Returns non-zero on a torn or out-of-order frame.
+int RunHandoff(Json& json, bool quick);
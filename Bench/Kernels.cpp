@@ -0,0 +1,68 @@
+#include "Kernels.h"
+#include "pixel_kernels.h"
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+
+typedef void (*ConvertFunction)(const uint8_t*, int, uint8_t*, int, int, int, int, bool, bool, bool);
+
+// Fastest of several runs, in milliseconds per image.
+static double TimeConvert(ConvertFunction convert, const std::vector<uint8_t>& src, std::vector<uint8_t>& dst, int width, int height, int channels, int flags, int iterations) {
+    double best = 0;
+    for (int i = 0; i < iterations; i++) {
+        double start = NowMs();
+        convert(src.data(), width * channels, dst.data(), width * channels, width, height, channels, flags & 1, flags & 2, flags & 4);
+        double ms = NowMs() - start;
+        if (i == 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+int RunKernels(Json& json, bool quick) {
+    struct Size {
+        int width, height;
+    };
+    static const Size sizes[] = {{640, 480}, {1920, 1080}, {1283, 7}};
+    int iterations = quick ? 5 : 50;
+    int mismatches = 0;
+    std::mt19937 random(7);
+
+    json.value("isa", Pixels::KernelIsa());
+    json.beginArray("kernels");
+    for (int channels = 3; channels <= 4; channels++) {
+        for (const Size& size : sizes) {
+            size_t bytes = (size_t)size.width * size.height * channels;
+            std::vector<uint8_t> src(bytes), fast(bytes), reference(bytes), copy(bytes);
+            for (auto& value : src) value = (uint8_t)random();
+            for (int flags = 0; flags < 8; flags++) {
+                Pixels::ConvertPacked(src.data(), size.width * channels, fast.data(), size.width * channels, size.width, size.height, channels, flags & 1, flags & 2, flags & 4);
+                Pixels::ConvertPackedScalar(src.data(), size.width * channels, reference.data(), size.width * channels, size.width, size.height, channels, flags & 1, flags & 2, flags & 4);
+                bool match = fast == reference;
+                // the same conversion written to two buffers, as a camera shared by several consumers does
+                std::fill(fast.begin(), fast.end(), 0);
+                Pixels::ConvertPackedTee(src.data(), size.width * channels, fast.data(), copy.data(), size.width * channels, size.width, size.height, channels, flags & 1, flags & 2, flags & 4);
+                match = match && fast == reference && copy == reference;
+                mismatches += !match;
+
+                double fastMs = TimeConvert(Pixels::ConvertPacked, src, fast, size.width, size.height, channels, flags, iterations);
+                double scalarMs = TimeConvert(Pixels::ConvertPackedScalar, src, reference, size.width, size.height, channels, flags, iterations);
+                json.beginObject();
+                json.value("channels", channels);
+                json.value("width", size.width);
+                json.value("height", size.height);
+                json.value("swap_rb", (flags & 1) != 0);
+                json.value("flip_x", (flags & 2) != 0);
+                json.value("flip_y", (flags & 4) != 0);
+                json.value("match", match);
+                json.value("ms", fastMs);
+                json.value("scalar_ms", scalarMs);
+                json.value("megabytes_per_second", fastMs > 0 ? bytes / (1024.0 * 1024.0) * 1000.0 / fastMs : 0.0);
+                json.value("speedup", fastMs > 0 ? scalarMs / fastMs : 0.0);
+                json.endObject();
+                if (!match) fprintf(stderr, "kernels: %dx%dx%d flags %d disagree with the scalar reference\n", size.width, size.height, channels, flags);
+            }
+        }
+    }
+    json.endArray();
+    return mismatches ? 1 : 0;
+}
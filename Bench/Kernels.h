@@ -0,0 +1,6 @@
+#pragma once
+#include "Report.h"
+
+// Checks the camera pixel kernels against their scalar reference and measures both, for every flag
+// combination of 24 and 32-bit images. Returns non-zero when a kernel disagrees with the reference.
+int RunKernels(Json& json, bool quick);
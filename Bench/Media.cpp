@@ -0,0 +1,211 @@
+#include "Media.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libavutil/imgutils.h>
+}
+
+static const int IndexBits = 16;
+static const int IndexBandHeight = 16;
+
+std::string ClipSpec::name() const {
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%s_%dx%d_g%d_b%d%s%s", codec.c_str(), width, height, gop, bframes, vfr ? "_vfr" : "", openGop ? "_open" : "");
+    std::string name = buffer;
+    if (startOffset) name += "_o" + std::to_string(startOffset);
+    if (rotation) name += "_r" + std::to_string(rotation);
+    return name + "_" + std::to_string(frames) + "f.mp4";
+}
+
+// Encoder time base is 1 / fps, or 1 / (2 * fps) for VFR clips.
+static int TimeBaseDen(const ClipSpec& spec) { return spec.vfr ? spec.fps * 2 : spec.fps; }
+
+static int64_t FramePts(const ClipSpec& spec, int64_t index) {
+    if (!spec.vfr) return spec.startOffset + index;
+    // 10 frames of 2 ticks, then 10 frames of 1 tick
+    int64_t cycle = index / 20, rest = index % 20;
+    return spec.startOffset * 2 + cycle * 30 + (rest < 10 ? rest * 2 : 20 + (rest - 10));
+}
+
+double FrameTime(const ClipSpec& spec, int64_t index) { return (double)(FramePts(spec, index) - FramePts(spec, 0)) / TimeBaseDen(spec); }
+
+int64_t ReadFrameIndex(const unsigned char* bgr, int stride, int width, int height) {
+    int cell = width / IndexBits;
+    if (cell < 2 || height < IndexBandHeight) return -1;
+    const unsigned char* row = bgr + (size_t)stride * (IndexBandHeight / 2);
+    int64_t index = 0;
+    for (int bit = 0; bit < IndexBits; bit++) {
+        const unsigned char* pixel = row + (bit * cell + cell / 2) * 3;
+        int luma = (pixel[0] + pixel[1] + pixel[2]) / 3;
+        if (luma > 80 && luma < 170) return -1;
+        index = (index << 1) | (luma >= 170 ? 1 : 0);
+    }
+    return index;
+}
+
+int64_t ReadRotatedFrameIndex(const ClipSpec& spec, const unsigned char* bgr, int stride, int width, int height) {
+    if (!spec.rotation) return ReadFrameIndex(bgr, stride, width, height);
+    // only the index band is turned back, pixel (x, y) of the coded picture
+    int codedWidth = spec.rotation == 180 ? width : height, codedHeight = spec.rotation == 180 ? height : width;
+    if (codedHeight < IndexBandHeight) return -1;
+    std::vector<unsigned char> band((size_t)codedWidth * 3 * IndexBandHeight);
+    for (int y = 0; y < IndexBandHeight; y++) {
+        for (int x = 0; x < codedWidth; x++) {
+            int dx = spec.rotation == 90 ? codedHeight - 1 - y : spec.rotation == 180 ? codedWidth - 1 - x : y;
+            int dy = spec.rotation == 90 ? x : spec.rotation == 180 ? codedHeight - 1 - y : codedWidth - 1 - x;
+            memcpy(&band[((size_t)y * codedWidth + x) * 3], bgr + (size_t)dy * stride + (size_t)dx * 3, 3);
+        }
+    }
+    return ReadFrameIndex(band.data(), codedWidth * 3, codedWidth, IndexBandHeight);
+}
+
+bool HasEncoder(const ClipSpec& spec) { return avcodec_find_encoder_by_name(spec.codec.c_str()) != nullptr; }
+
+std::string FFmpegVersion() { return av_version_info(); }
+
+static void DrawFrame(AVFrame* frame, int64_t index) {
+    int width = frame->width;
+    int height = frame->height;
+    for (int y = 0; y < height; y++) {
+        uint8_t* row = frame->data[0] + (size_t)y * frame->linesize[0];
+        for (int x = 0; x < width; x++) {
+            row[x] = (uint8_t)(16 + ((x + y + index * 4) & 0x7f) + ((x / 64 + y / 64 + index) & 1) * 64);
+        }
+    }
+    // most significant bit first, wide cells survive chroma subsampling and coarse quantizers
+    int cell = width / IndexBits;
+    for (int bit = 0; bit < IndexBits; bit++) {
+        uint8_t value = ((index >> (IndexBits - 1 - bit)) & 1) ? 235 : 16;
+        for (int y = 0; y < IndexBandHeight && y < height; y++) {
+            memset(frame->data[0] + (size_t)y * frame->linesize[0] + bit * cell, value, cell);
+        }
+    }
+    for (int plane = 1; plane < 3; plane++) {
+        int chroma_height = AV_CEIL_RSHIFT(height, 1);
+        for (int y = 0; y < chroma_height; y++) {
+            uint8_t* row = frame->data[plane] + (size_t)y * frame->linesize[plane];
+            for (int x = 0; x < AV_CEIL_RSHIFT(width, 1); x++) {
+                row[x] = y < IndexBandHeight / 2 ? 128 : (uint8_t)(128 + ((plane == 1 ? x : y) + index) % 64 - 32);
+            }
+        }
+    }
+}
+
+static bool WritePackets(AVCodecContext* enc, AVFormatContext* oc, AVStream* stream, AVPacket* packet) {
+    for (;;) {
+        int ret = avcodec_receive_packet(enc, packet);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) return true;
+        if (ret < 0) return false;
+        av_packet_rescale_ts(packet, enc->time_base, stream->time_base);
+        packet->stream_index = stream->index;
+        if (av_interleaved_write_frame(oc, packet) < 0) return false;
+    }
+}
+
+bool GenerateClip(const ClipSpec& spec, const std::string& path, std::string& error) {
+    const AVCodec* codec = avcodec_find_encoder_by_name(spec.codec.c_str());
+    if (!codec) {
+        error = "encoder not available";
+        return false;
+    }
+
+    AVFormatContext* oc = nullptr;
+    AVCodecContext* enc = nullptr;
+    AVFrame* frame = nullptr;
+    AVPacket* packet = nullptr;
+    bool ok = false;
+
+    do {
+        if (avformat_alloc_output_context2(&oc, nullptr, nullptr, path.c_str()) < 0 || !oc) {
+            error = "no muxer for " + path;
+            break;
+        }
+        AVStream* stream = avformat_new_stream(oc, nullptr);
+        enc = avcodec_alloc_context3(codec);
+        if (!stream || !enc) {
+            error = "out of memory";
+            break;
+        }
+        enc->width = spec.width;
+        enc->height = spec.height;
+        enc->time_base = AVRational{1, TimeBaseDen(spec)};
+        // average of a VFR cycle, 20 frames in 30 ticks
+        enc->framerate = spec.vfr ? AVRational{spec.fps * 4, 3} : AVRational{spec.fps, 1};
+        enc->gop_size = spec.gop;
+        enc->max_b_frames = spec.bframes;
+        enc->pix_fmt = codec->id == AV_CODEC_ID_MJPEG ? AV_PIX_FMT_YUVJ420P : AV_PIX_FMT_YUV420P;
+        // a single encoder thread keeps the output bit exact across machines
+        enc->thread_count = 1;
+        if (codec->id == AV_CODEC_ID_H264) {
+            av_opt_set(enc->priv_data, "preset", "veryfast", 0);
+            av_opt_set(enc->priv_data, "crf", "23", 0);
+            if (spec.gop > 0) av_opt_set_int(enc->priv_data, "keyint_min", spec.gop, 0);
+            if (spec.openGop) av_opt_set(enc->priv_data, "x264-params", "open-gop=1", 0);
+        } else {
+            enc->flags |= AV_CODEC_FLAG_QSCALE;
+            enc->global_quality = FF_QP2LAMBDA * 4;
+        }
+        if (oc->oformat->flags & AVFMT_GLOBALHEADER) enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        if (avcodec_open2(enc, codec, nullptr) < 0) {
+            error = "could not open encoder";
+            break;
+        }
+        if (avcodec_parameters_from_context(stream->codecpar, enc) < 0) break;
+        stream->time_base = enc->time_base;
+        stream->avg_frame_rate = enc->framerate;
+        // the mp4 muxer turns this into the track's display matrix
+        if (spec.rotation) av_dict_set(&stream->metadata, "rotate", std::to_string(spec.rotation).c_str(), 0);
+
+        if (!(oc->oformat->flags & AVFMT_NOFILE) && avio_open(&oc->pb, path.c_str(), AVIO_FLAG_WRITE) < 0) {
+            error = "could not create " + path;
+            break;
+        }
+        if (avformat_write_header(oc, nullptr) < 0) {
+            error = "could not write header";
+            break;
+        }
+
+        frame = av_frame_alloc();
+        packet = av_packet_alloc();
+        if (!frame || !packet) break;
+        frame->format = enc->pix_fmt;
+        frame->width = enc->width;
+        frame->height = enc->height;
+        if (av_frame_get_buffer(frame, 0) < 0) break;
+
+        int64_t index = 0;
+        for (; index < spec.frames; index++) {
+            if (av_frame_make_writable(frame) < 0) break;
+            DrawFrame(frame, index);
+            frame->pts = FramePts(spec, index);
+            if (avcodec_send_frame(enc, frame) < 0 || !WritePackets(enc, oc, stream, packet)) break;
+        }
+        if (index != spec.frames) {
+            error = "encoding failed";
+            break;
+        }
+        avcodec_send_frame(enc, nullptr);
+        if (!WritePackets(enc, oc, stream, packet)) {
+            error = "encoding failed";
+            break;
+        }
+        ok = av_write_trailer(oc) >= 0;
+    } while (false);
+
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+    avcodec_free_context(&enc);
+    if (oc) {
+        if (!(oc->oformat->flags & AVFMT_NOFILE)) avio_closep(&oc->pb);
+        avformat_free_context(oc);
+    }
+    if (!ok) {
+        if (error.empty()) error = "encoding failed";
+        remove(path.c_str());
+    }
+    return ok;
+}
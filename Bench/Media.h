@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Describes a synthetic clip, identical specs always produce identical files.
+struct ClipSpec {
+    std::string codec;  // FFmpeg encoder name, e.g. "libx264", "mpeg4", "mjpeg"
+    int width = 640;
+    int height = 360;
+    int fps = 30;
+    int frames = 300;
+    int gop = 30;
+    int bframes = 0;
+    // Frame durations alternate between 1 / fps and 1 / (2 * fps) every 10 frames.
+    bool vfr = false;
+    // GOPs may reference the previous GOP (libx264 only).
+    bool openGop = false;
+    // The first frame is stamped startOffset frames late, the container records it as an edit.
+    int startOffset = 0;
+    // Clockwise display rotation stored as stream metadata (0, 90, 180 or 270), the pictures stay unrotated.
+    int rotation = 0;
+
+    // e.g. "libx264_640x360_g30_b0_300f.mp4", "libx264_640x360_g30_b3_vfr_open_o15_r90_240f.mp4"
+    std::string name() const;
+};
+
+// Checks whether this FFmpeg build has the encoder of the spec.
+bool HasEncoder(const ClipSpec& spec);
+
+// Encodes spec into path, every frame carries a moving gradient and its own index as a band of
+// black / white cells along the top edge. Returns false and removes the file on failure.
+bool GenerateClip(const ClipSpec& spec, const std::string& path, std::string& error);
+
+// Presentation time of a frame in seconds, relative to the first frame.
+double FrameTime(const ClipSpec& spec, int64_t index);
+
+// Reads the index band back from a decoded BGR24 picture, -1 when a cell is neither clearly black nor white.
+int64_t ReadFrameIndex(const unsigned char* bgr, int stride, int width, int height);
+// Same for a picture displayed with the spec's rotation, width and height are the displayed size.
+int64_t ReadRotatedFrameIndex(const ClipSpec& spec, const unsigned char* bgr, int stride, int width, int height);
+
+// The FFmpeg version the clips were generated with, recorded next to the results.
+std::string FFmpegVersion();
@@ -0,0 +1,110 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+inline double NowMs() { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+// Nearest-rank percentiles of a set of samples (milliseconds).
+struct Samples {
+    std::vector<double> values;
+
+    void add(double value) { values.push_back(value); }
+    bool empty() const { return values.empty(); }
+    double percentile(double p) const {
+        if (values.empty()) return 0;
+        std::vector<double> sorted(values);
+        std::sort(sorted.begin(), sorted.end());
+        size_t rank = (size_t)std::max(0.0, p / 100.0 * sorted.size() - 1e-9);
+        return sorted[std::min(rank, sorted.size() - 1)];
+    }
+    double mean() const {
+        double sum = 0;
+        for (double value : values) sum += value;
+        return values.empty() ? 0 : sum / values.size();
+    }
+};
+
+// Minimal streaming JSON writer, keys are emitted in call order so diffs of two runs line up.
+class Json {
+public:
+    Json& beginObject(const char* key = nullptr) { return open(key, '{'); }
+    Json& endObject() { return close('}'); }
+    Json& beginArray(const char* key = nullptr) { return open(key, '['); }
+    Json& endArray() { return close(']'); }
+
+    Json& value(const char* key, const std::string& text) {
+        prefix(key);
+        quote(text);
+        return *this;
+    }
+    Json& value(const char* key, const char* text) { return value(key, std::string(text)); }
+    Json& value(const char* key, double number) {
+        prefix(key);
+        m_out.precision(6);
+        m_out << number;
+        return *this;
+    }
+    Json& value(const char* key, int64_t number) {
+        prefix(key);
+        m_out << number;
+        return *this;
+    }
+    Json& value(const char* key, int number) { return value(key, (int64_t)number); }
+    Json& value(const char* key, bool flag) {
+        prefix(key);
+        m_out << (flag ? "true" : "false");
+        return *this;
+    }
+    // {"mean": .., "p50": .., "p90": .., "p99": .., "max": .., "count": ..}
+    Json& samples(const char* key, const Samples& samples) {
+        beginObject(key);
+        value("mean", samples.mean());
+        value("p50", samples.percentile(50));
+        value("p90", samples.percentile(90));
+        value("p99", samples.percentile(99));
+        value("max", samples.percentile(100));
+        value("count", (int64_t)samples.values.size());
+        return endObject();
+    }
+
+    std::string str() const { return m_out.str(); }
+
+private:
+    Json& open(const char* key, char bracket) {
+        prefix(key);
+        m_out << bracket;
+        m_first.push_back(true);
+        return *this;
+    }
+    Json& close(char bracket) {
+        m_first.pop_back();
+        m_out << '\n' << std::string(m_first.size() * 2, ' ') << bracket;
+        return *this;
+    }
+    void prefix(const char* key) {
+        if (!m_first.empty()) {
+            if (!m_first.back()) m_out << ',';
+            m_first.back() = false;
+            m_out << '\n' << std::string(m_first.size() * 2, ' ');
+        }
+        if (key) {
+            quote(key);
+            m_out << ": ";
+        }
+    }
+    void quote(const std::string& text) {
+        m_out << '"';
+        for (char c : text) {
+            if (c == '"' || c == '\\') m_out << '\\';
+            m_out << c;
+        }
+        m_out << '"';
+    }
+
+    std::ostringstream m_out;
+    std::vector<bool> m_first;
+};
@@ -0,0 +1,75 @@
+#include "System.h"
+#include <stdio.h>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <Windows.h>
+#include <direct.h>
+#else
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+
+ProcessUsage GetProcessUsage() {
+    ProcessUsage usage;
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        auto ticks = [](const FILETIME& time) { return ((uint64_t)time.dwHighDateTime << 32) | time.dwLowDateTime; };
+        // 100ns units
+        usage.cpuMs = (ticks(kernel) + ticks(user)) / 10000.0;
+    }
+#else
+    struct rusage self;
+    if (getrusage(RUSAGE_SELF, &self) == 0) {
+        usage.cpuMs = (self.ru_utime.tv_sec + self.ru_stime.tv_sec) * 1000.0 + (self.ru_utime.tv_usec + self.ru_stime.tv_usec) / 1000.0;
+        usage.voluntarySwitches = self.ru_nvcsw;
+        usage.involuntarySwitches = self.ru_nivcsw;
+    }
+#endif
+    return usage;
+}
+
+int GetCpuCount() {
+    unsigned count = std::thread::hardware_concurrency();
+    return count ? (int)count : 1;
+}
+
+void MakeDirectory(const std::string& path) {
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+bool FileExists(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file) fclose(file);
+    return file != nullptr;
+}
+
+bool WriteFile(const std::string& path, const std::string& content) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    bool ok = fwrite(content.data(), 1, content.size(), file) == content.size();
+    return fclose(file) == 0 && ok;
+}
+
+bool CopyBinaryFile(const std::string& from, const std::string& to) {
+    FILE* in = fopen(from.c_str(), "rb");
+    if (!in) return false;
+    FILE* out = fopen(to.c_str(), "wb");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+    std::vector<char> buffer(1 << 20);
+    bool ok = true;
+    size_t size;
+    while (ok && (size = fread(buffer.data(), 1, buffer.size(), in)) > 0) {
+        ok = fwrite(buffer.data(), 1, size, out) == size;
+    }
+    fclose(in);
+    return fclose(out) == 0 && ok;
+}
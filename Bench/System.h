@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Resource usage of the whole process since it started.
+struct ProcessUsage {
+    double cpuMs = 0;  // user + system time of all threads
+    // -1 where the platform does not report them per process
+    int64_t voluntarySwitches = -1;
+    int64_t involuntarySwitches = -1;
+};
+
+ProcessUsage GetProcessUsage();
+int GetCpuCount();
+bool CopyBinaryFile(const std::string& from, const std::string& to);
+bool FileExists(const std::string& path);
+bool WriteFile(const std::string& path, const std::string& content);
+void MakeDirectory(const std::string& path);
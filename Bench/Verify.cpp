@@ -0,0 +1,206 @@
+#include "Verify.h"
+#include "Media.h"
+#include "System.h"
+#include "VI.h"
+#include <stdio.h>
+#include <random>
+
+static VI::String ToString(const std::string& str) { return VI::String(str.c_str(), str.size()); }
+
+struct SeekResult {
+    int64_t checked = 0;
+    int64_t correct = 0;
+    int64_t offByOne = 0;
+    int64_t wrong = 0;
+    int64_t unreadable = 0;  // no frame, or the index band did not decode
+    Samples latency;
+    std::vector<std::pair<int64_t, int64_t>> failures;  // (expected, delivered), the first few only
+
+    void add(int64_t expected, int64_t delivered, double ms) {
+        checked++;
+        latency.add(ms);
+        if (delivered == expected) {
+            correct++;
+            return;
+        }
+        if (delivered < 0) {
+            unreadable++;
+        } else if (delivered == expected - 1 || delivered == expected + 1) {
+            offByOne++;
+        } else {
+            wrong++;
+        }
+        if (failures.size() < 8) failures.emplace_back(expected, delivered);
+    }
+    bool passed() const { return correct == checked; }
+};
+
+// The index of the frame to be grabbed next, converted to BGR24.
+static int64_t GrabIndex(const ClipSpec& spec, VI::Video& video, std::vector<unsigned char>& buffer) {
+    int width = video.getWidth(), height = video.getHeight();
+    buffer.resize((size_t)width * 3 * height);
+    if (!video.grab() || !video.retrieve(buffer.data(), width * 3)) return -1;
+    return ReadRotatedFrameIndex(spec, buffer.data(), width * 3, width, height);
+}
+
+// The index of the frame on screen after the last grab, without grabbing.
+static int64_t CurrentIndex(const ClipSpec& spec, VI::Video& video, std::vector<unsigned char>& buffer) {
+    int width = video.getWidth(), height = video.getHeight();
+    buffer.resize((size_t)width * 3 * height);
+    if (!video.retrieve(buffer.data(), width * 3)) return -1;
+    return ReadRotatedFrameIndex(spec, buffer.data(), width * 3, width, height);
+}
+
+static void WriteResult(Json& json, const char* mode, const SeekResult& result, bool exact) {
+    json.beginObject();
+    json.value("mode", mode);
+    // seeks by frame number or time map through the average frame rate, which only matches CFR clips
+    json.value("exact", exact);
+    json.value("passed", result.passed());
+    json.value("checked", result.checked);
+    json.value("correct", result.correct);
+    json.value("off_by_one", result.offByOne);
+    json.value("wrong", result.wrong);
+    json.value("unreadable", result.unreadable);
+    json.samples("latency_ms", result.latency);
+    json.beginArray("failures");
+    for (auto& failure : result.failures) {
+        json.beginObject();
+        json.value("expected", failure.first);
+        json.value("delivered", failure.second);
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+}
+
+// Returns the number of exact modes that failed.
+static int VerifyClip(Json& json, const ClipSpec& spec, const std::string& path, int seeks) {
+    VI::Video video(ToString(path));
+    if (!video.isOpened()) {
+        json.value("error", "open failed");
+        return 1;
+    }
+    // rotated clips report and deliver their displayed size
+    bool sideways = spec.rotation % 180 != 0;
+    int displayWidth = sideways ? spec.height : spec.width, displayHeight = sideways ? spec.width : spec.height;
+    if (video.getWidth() != displayWidth || video.getHeight() != displayHeight) {
+        json.value("error", "unexpected size");
+        json.value("width", video.getWidth());
+        json.value("height", video.getHeight());
+        return 1;
+    }
+    std::vector<unsigned char> buffer;
+    int failed = 0;
+    json.beginArray("modes");
+
+    SeekResult sequential;
+    double start = NowMs();
+    for (int64_t index = 0; index < spec.frames; index++) {
+        int64_t delivered = GrabIndex(spec, video, buffer);
+        sequential.add(index, delivered, NowMs() - start);
+        start = NowMs();
+        if (delivered < 0) break;
+    }
+    WriteResult(json, "sequential", sequential, true);
+    failed += !sequential.passed();
+
+    // fixed seed, the same targets on every run
+    std::mt19937 random(4242);
+    std::uniform_int_distribution<int64_t> targets(0, spec.frames - 1);
+
+    // seekFrame(n) leaves frame n - 1 on screen, the next grab delivers frame n
+    SeekResult seekFrame;
+    for (int i = 0; i < seeks; i++) {
+        int64_t target = targets(random);
+        start = NowMs();
+        video.seekFrame(target);
+        int64_t delivered = GrabIndex(spec, video, buffer);
+        seekFrame.add(target, delivered, NowMs() - start);
+    }
+    WriteResult(json, "seek_frame", seekFrame, !spec.vfr);
+    failed += !spec.vfr && !seekFrame.passed();
+
+    SeekResult seekTime;
+    for (int i = 0; i < seeks; i++) {
+        int64_t target = targets(random);
+        start = NowMs();
+        video.seekTime(FrameTime(spec, target));
+        int64_t delivered = GrabIndex(spec, video, buffer);
+        seekTime.add(target, delivered, NowMs() - start);
+    }
+    WriteResult(json, "seek_time", seekTime, !spec.vfr);
+    failed += !spec.vfr && !seekTime.passed();
+
+    // grabAt only steps forward, so the targets are visited in ascending order from the start
+    std::vector<int64_t> ascending;
+    for (int i = 0; i < seeks; i++) ascending.push_back(targets(random));
+    std::sort(ascending.begin(), ascending.end());
+    SeekResult grabAt;
+    video.seekFrame(0);
+    for (int64_t target : ascending) {
+        start = NowMs();
+        int64_t delivered = video.grabAt(FrameTime(spec, target)) ? CurrentIndex(spec, video, buffer) : -1;
+        grabAt.add(target, delivered, NowMs() - start);
+    }
+    WriteResult(json, "grab_at", grabAt, true);
+    failed += !grabAt.passed();
+
+    json.endArray();
+    return failed;
+}
+
+int RunVerify(Json& json, const std::string& dir, bool quick, int seeks) {
+    struct Entry {
+        const char* codec;
+        int gop, bframes;
+        bool vfr, openGop;
+        int startOffset;
+        int rotation;
+    };
+    // reordering, open GOPs, VFR and edit lists, each on its own and all together, then rotation metadata
+    static const Entry entries[] = {
+        {"libx264", 30, 0, false, false, 0, 0}, {"libx264", 30, 3, false, false, 0, 0}, {"libx264", 30, 3, false, true, 0, 0}, {"libx264", 30, 3, true, false, 0, 0},
+        {"libx264", 30, 3, false, false, 15, 0}, {"libx264", 30, 3, true, true, 15, 0}, {"mpeg4", 12, 2, false, false, 0, 0},  {"mpeg4", 12, 2, true, false, 7, 0},
+        {"mjpeg", 1, 0, false, false, 0, 0}, {"libx264", 30, 3, false, false, 0, 90}, {"libx264", 30, 0, false, false, 0, 180}, {"mpeg4", 12, 2, false, false, 0, 270},
+    };
+    int failed = 0;
+    json.beginArray("verify");
+    for (const Entry& entry : entries) {
+        ClipSpec spec;
+        spec.codec = entry.codec;
+        spec.gop = entry.gop;
+        spec.bframes = entry.bframes;
+        spec.vfr = entry.vfr;
+        spec.openGop = entry.openGop;
+        spec.startOffset = entry.startOffset;
+        spec.rotation = entry.rotation;
+        // sideways clips are coded portrait and displayed landscape, like phone recordings
+        if (spec.rotation % 180) std::swap(spec.width, spec.height);
+        spec.frames = quick ? 90 : 240;
+
+        std::string path = dir + "/" + spec.name();
+        json.beginObject();
+        json.value("name", spec.name());
+        if (!HasEncoder(spec)) {
+            fprintf(stderr, "%s: skipped, encoder not available\n", spec.name().c_str());
+            json.value("skipped", "encoder not available");
+            json.endObject();
+            continue;
+        }
+        std::string error;
+        if (!FileExists(path) && !GenerateClip(spec, path, error)) {
+            fprintf(stderr, "%s: generation failed, %s\n", spec.name().c_str(), error.c_str());
+            json.value("error", error);
+            json.endObject();
+            failed++;
+            continue;
+        }
+        int clipFailed = VerifyClip(json, spec, path, seeks);
+        fprintf(stderr, "%s: %s\n", spec.name().c_str(), clipFailed ? "FAILED" : "passed");
+        failed += clipFailed;
+        json.endObject();
+    }
+    json.endArray();
+    return failed ? 1 : 0;
+}
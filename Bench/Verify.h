@@ -0,0 +1,7 @@
+#pragma once
+#include "Report.h"
+#include <string>
+
+// Seeks at random into clips that carry their frame index in the picture and checks the delivered frame, for
+// seekFrame, seekTime, grabAt and plain sequential decoding. Returns non-zero when an exact mode failed.
+int RunVerify(Json& json, const std::string& dir, bool quick, int seeks);
@@ -0,0 +1,428 @@
+#include "VI.h"
+#include "Media.h"
+#include "Report.h"
+#include "System.h"
+#include "Verify.h"
+#include "Kernels.h"
+#include "Handoff.h"
+#include "Camera.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <random>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+struct Options {
+    std::string out;
+    std::string dir = "vi_bench_media";
+    std::vector<std::string> codecs;
+    bool quick = false;
+    int repeat = 20;
+    int seeks = 200;
+    // > 0 runs the multi-instance scaling mode instead of the per-clip suite
+    int scaling = 0;
+    // runs the frame-accurate seek verification instead of the per-clip suite
+    bool verify = false;
+    // checks and measures the camera pixel kernels, no clips involved
+    bool kernels = false;
+    // stress test of the camera frame handoff, no clips involved
+    bool handoff = false;
+    // capture to consume through VI::Camera on V4L2 and virtual devices, Linux only
+    bool camera = false;
+};
+
+static void PrintUsage() {
+    fprintf(stderr,
+            "usage: vi_bench [options]\n"
+            "  --out <file>     write the JSON results to file instead of stdout\n"
+            "  --dir <dir>      where the synthetic clips are generated and reused (default vi_bench_media)\n"
+            "  --codec <name>   only clips of this encoder, may be repeated\n"
+            "  --repeat <n>     opens / probes per clip (default 20)\n"
+            "  --seeks <n>      random seeks per clip and mode (default 200)\n"
+            "  --quick          short 360p clips only, for smoke runs\n"
+            "  --verify         check the frame delivered by every seek mode on index-stamped clips\n"
+            "  --kernels        check the camera flip / channel swap kernels against the scalar reference and time them\n"
+            "  --camera         capture, convert and consume through V4L2 and virtual cameras (Linux)\n"
+            "  --handoff        stress the lock-free camera frame handoff with fast and slow consumers\n"
+            "  --scaling <n>    decode with 1, 2, 4 .. n concurrent Video instances on one file and on distinct files\n");
+}
+
+static bool ParseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--out" && hasValue) {
+            options.out = argv[++i];
+        } else if (arg == "--dir" && hasValue) {
+            options.dir = argv[++i];
+        } else if (arg == "--codec" && hasValue) {
+            options.codecs.push_back(argv[++i]);
+        } else if (arg == "--repeat" && hasValue) {
+            options.repeat = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--seeks" && hasValue) {
+            options.seeks = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--scaling" && hasValue) {
+            options.scaling = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--camera") {
+            options.camera = true;
+        } else if (arg == "--handoff") {
+            options.handoff = true;
+        } else if (arg == "--kernels") {
+            options.kernels = true;
+        } else if (arg == "--verify") {
+            options.verify = true;
+        } else if (arg == "--quick") {
+            options.quick = true;
+        } else {
+            return false;
+        }
+    }
+    if (options.quick) {
+        options.repeat = std::min(options.repeat, 5);
+        options.seeks = std::min(options.seeks, 20);
+    }
+    return true;
+}
+
+static VI::String ToString(const std::string& str) { return VI::String(str.c_str(), str.size()); }
+
+// codec x resolution x GOP x B-frames, chosen to cover intra-only, short and long GOPs with and without reordering
+static std::vector<ClipSpec> DefaultClips(const Options& options) {
+    struct Entry {
+        const char* codec;
+        int width, height, gop, bframes;
+        bool quick;
+    };
+    static const Entry entries[] = {
+        {"libx264", 640, 360, 30, 0, true},  {"libx264", 640, 360, 30, 3, true},    {"libx264", 640, 360, 250, 3, false},
+        {"libx264", 1920, 1080, 30, 3, false}, {"mpeg4", 640, 360, 12, 0, true},   {"mpeg4", 640, 360, 12, 2, false},
+        {"mpeg4", 1920, 1080, 12, 2, false},   {"mjpeg", 640, 360, 1, 0, true},
+    };
+    std::vector<ClipSpec> clips;
+    for (const Entry& entry : entries) {
+        if (options.quick && !entry.quick) continue;
+        if (!options.codecs.empty() && std::find(options.codecs.begin(), options.codecs.end(), entry.codec) == options.codecs.end()) continue;
+        ClipSpec spec;
+        spec.codec = entry.codec;
+        spec.width = entry.width;
+        spec.height = entry.height;
+        spec.gop = entry.gop;
+        spec.bframes = entry.bframes;
+        spec.frames = options.quick ? 90 : 300;
+        clips.push_back(spec);
+    }
+    return clips;
+}
+
+// Open + grab + convert of the first frame, what a thumbnailer pays per file.
+static double FirstFrameMs(const std::string& path, const VI::VideoParams& params, std::vector<unsigned char>& buffer) {
+    double start = NowMs();
+    VI::Video video(ToString(path), params);
+    if (!video.isOpened() || !video.grab()) return -1;
+    int stride = video.getWidth() * 3;
+    buffer.resize((size_t)stride * video.getHeight());
+    if (!video.retrieve(buffer.data(), stride)) return -1;
+    return NowMs() - start;
+}
+
+static void BenchClip(Json& json, const ClipSpec& spec, const std::string& path, const Options& options) {
+    VI::VideoParams defaults;
+    VI::VideoParams fastOpen;
+    fastOpen.trustContainerHeader = true;
+    fastOpen.probeSize = 32 * 1024;
+    fastOpen.analyzeDurationUs = 100000;
+    std::vector<unsigned char> buffer;
+
+    Samples openDefault, openFast, firstFrame, probe;
+    for (int i = 0; i < options.repeat; i++) {
+        double start = NowMs();
+        {
+            VI::Video video(ToString(path), defaults);
+            if (!video.isOpened()) break;
+        }
+        openDefault.add(NowMs() - start);
+        start = NowMs();
+        {
+            VI::Video video(ToString(path), fastOpen);
+            if (!video.isOpened()) break;
+        }
+        openFast.add(NowMs() - start);
+        double ms = FirstFrameMs(path, defaults, buffer);
+        if (ms >= 0) firstFrame.add(ms);
+        VI::VideoInfo info;
+        start = NowMs();
+        if (VI::Probe(ToString(path), info)) probe.add(NowMs() - start);
+    }
+    json.samples("open_ms", openDefault);
+    json.samples("open_fast_ms", openFast);
+    json.samples("first_frame_ms", firstFrame);
+    json.samples("probe_ms", probe);
+    json.value("probes_per_second", probe.mean() > 0 ? 1000.0 / probe.mean() : 0.0);
+
+    VI::Video video(ToString(path), defaults);
+    if (!video.isOpened()) {
+        json.value("error", "open failed");
+        return;
+    }
+    int width = video.getWidth();
+    int height = video.getHeight();
+    int64_t framesCount = video.getFramesCount();
+
+    // decode only, nothing converted
+    int64_t decoded = 0;
+    double start = NowMs();
+    while (video.grab()) decoded++;
+    double decodeMs = NowMs() - start;
+    json.beginObject("decode");
+    json.value("frames", decoded);
+    json.value("expected_frames", (int64_t)spec.frames);
+    json.value("fps", decodeMs > 0 ? decoded * 1000.0 / decodeMs : 0.0);
+    json.endObject();
+
+    // decode + BGR24 conversion, the conversion timed on its own
+    int stride = width * 3;
+    buffer.resize((size_t)stride * height);
+    video.seekFrame(0);
+    Samples convert;
+    int64_t converted = 0;
+    start = NowMs();
+    while (video.grab()) {
+        double convertStart = NowMs();
+        if (!video.retrieve(buffer.data(), stride)) break;
+        convert.add(NowMs() - convertStart);
+        converted++;
+    }
+    double totalMs = NowMs() - start;
+    json.beginObject("convert");
+    json.value("frames", converted);
+    json.value("fps", totalMs > 0 ? converted * 1000.0 / totalMs : 0.0);
+    json.value("convert_only_fps", convert.mean() > 0 ? 1000.0 / convert.mean() : 0.0);
+    json.value("megabytes_per_second", convert.mean() > 0 ? (double)stride * height / (1024.0 * 1024.0) * 1000.0 / convert.mean() : 0.0);
+    json.samples("convert_ms", convert);
+    json.endObject();
+
+    // fixed seed, every run seeks to the same positions
+    std::mt19937 random(12345);
+    std::uniform_int_distribution<int64_t> frames(0, std::max<int64_t>(framesCount - 1, 0));
+    Samples seekFrame, seekTime;
+    for (int i = 0; i < options.seeks; i++) {
+        int64_t target = frames(random);
+        double seekStart = NowMs();
+        video.seekFrame(target);
+        seekFrame.add(NowMs() - seekStart);
+    }
+    for (int i = 0; i < options.seeks; i++) {
+        double target = frames(random) / (double)spec.fps;
+        double seekStart = NowMs();
+        video.seekTime(target);
+        seekTime.add(NowMs() - seekStart);
+    }
+    json.samples("seek_frame_ms", seekFrame);
+    json.samples("seek_time_ms", seekTime);
+}
+
+// Decodes and converts every frame of files[i % files.size()] on instance i, all instances start together
+// once they are opened. CPU time and context switches are taken for the whole process.
+static void RunScaling(Json& json, const std::vector<std::string>& files, int instances, int decoderThreads) {
+    VI::VideoParams params;
+    params.decoderThreads = decoderThreads;
+    std::mutex mutex;
+    std::condition_variable cond;
+    int ready = 0;
+    bool go = false;
+    std::atomic<int64_t> frames{0};
+    std::atomic<int> failures{0};
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < instances; i++) {
+        threads.emplace_back([&, i]() {
+            VI::Video video(ToString(files[i % files.size()]), params);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready++;
+                cond.notify_all();
+                cond.wait(lock, [&]() { return go; });
+            }
+            if (!video.isOpened()) {
+                failures++;
+                return;
+            }
+            int stride = video.getWidth() * 4;
+            std::vector<unsigned char> buffer((size_t)stride * video.getHeight());
+            int64_t count = 0;
+            while (video.grab() && video.retrieve(buffer.data(), stride, VI::PixelFormat::BGRA)) count++;
+            frames += count;
+        });
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&]() { return ready == instances; });
+    }
+    ProcessUsage before = GetProcessUsage();
+    double start = NowMs();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        go = true;
+        cond.notify_all();
+    }
+    for (auto& thread : threads) thread.join();
+    double wallMs = NowMs() - start;
+    ProcessUsage after = GetProcessUsage();
+
+    double fps = wallMs > 0 ? frames * 1000.0 / wallMs : 0;
+    json.beginObject();
+    json.value("instances", instances);
+    json.value("distinct_files", (int)std::min<size_t>(files.size(), instances));
+    json.value("decoder_threads", decoderThreads);
+    json.value("failures", failures.load());
+    json.value("frames", frames.load());
+    json.value("seconds", wallMs / 1000.0);
+    json.value("aggregate_fps", fps);
+    json.value("per_instance_fps", fps / instances);
+    // 1.0 means every core was busy for the whole run
+    json.value("cpu_utilization", wallMs > 0 ? (after.cpuMs - before.cpuMs) / (wallMs * GetCpuCount()) : 0.0);
+    if (after.voluntarySwitches >= 0) {
+        int64_t voluntary = after.voluntarySwitches - before.voluntarySwitches;
+        int64_t involuntary = after.involuntarySwitches - before.involuntarySwitches;
+        json.value("voluntary_switches", voluntary);
+        json.value("involuntary_switches", involuntary);
+        json.value("switches_per_frame", frames ? (double)(voluntary + involuntary) / frames : 0.0);
+    }
+    json.endObject();
+    fprintf(stderr, "scaling: %d instances, %d files, %d decoder threads: %.1f fps\n", instances, (int)std::min<size_t>(files.size(), instances), decoderThreads, fps);
+}
+
+static int RunScalingMode(Json& json, const Options& options) {
+    ClipSpec spec;
+    for (const ClipSpec& clip : DefaultClips(options)) {
+        if (HasEncoder(clip)) {
+            spec = clip;
+            break;
+        }
+    }
+    if (spec.codec.empty()) {
+        fprintf(stderr, "scaling: no encoder available\n");
+        return 1;
+    }
+    std::string path = options.dir + "/" + spec.name();
+    std::string error;
+    if (!FileExists(path) && !GenerateClip(spec, path, error)) {
+        fprintf(stderr, "%s: generation failed, %s\n", spec.name().c_str(), error.c_str());
+        return 1;
+    }
+    // byte copies, separate files without sharing the demuxer's view of one file
+    std::vector<std::string> distinct;
+    for (int i = 0; i < options.scaling; i++) {
+        std::string copy = options.dir + "/scaling_" + std::to_string(i) + "_" + spec.name();
+        if (!FileExists(copy) && !CopyBinaryFile(path, copy)) {
+            fprintf(stderr, "could not copy %s\n", path.c_str());
+            return 1;
+        }
+        distinct.push_back(copy);
+    }
+
+    std::vector<int> counts;
+    for (int count = 1; count < options.scaling; count *= 2) counts.push_back(count);
+    counts.push_back(options.scaling);
+
+    json.value("clip", spec.name());
+    json.value("cpus", GetCpuCount());
+    json.beginArray("scaling");
+    // 0: FFmpeg picks one thread per core for every instance, 1: one thread per instance
+    for (int decoderThreads : {0, 1}) {
+        for (int count : counts) {
+            RunScaling(json, std::vector<std::string>{path}, count, decoderThreads);
+            if (count > 1) RunScaling(json, distinct, count, decoderThreads);
+        }
+    }
+    json.endArray();
+    return 0;
+}
+
+static int RunSuite(Json& json, const Options& options) {
+    bool coldMeasured = false;
+    int failures = 0;
+    json.beginArray("clips");
+    for (const ClipSpec& spec : DefaultClips(options)) {
+        std::string path = options.dir + "/" + spec.name();
+        json.beginObject();
+        json.value("name", spec.name());
+        json.value("codec", spec.codec);
+        json.value("width", spec.width);
+        json.value("height", spec.height);
+        json.value("fps", spec.fps);
+        json.value("frames", spec.frames);
+        json.value("gop", spec.gop);
+        json.value("bframes", spec.bframes);
+        if (!HasEncoder(spec)) {
+            fprintf(stderr, "%s: skipped, encoder not available\n", spec.name().c_str());
+            json.value("skipped", "encoder not available");
+            json.endObject();
+            continue;
+        }
+        std::string error;
+        if (!FileExists(path) && !GenerateClip(spec, path, error)) {
+            fprintf(stderr, "%s: generation failed, %s\n", spec.name().c_str(), error.c_str());
+            json.value("error", error);
+            json.endObject();
+            failures++;
+            continue;
+        }
+        if (!coldMeasured) {
+            // the first open of the process also pays for loading and initializing FFmpeg
+            std::vector<unsigned char> buffer;
+            json.value("cold_start_first_frame_ms", FirstFrameMs(path, VI::VideoParams(), buffer));
+            coldMeasured = true;
+        }
+        fprintf(stderr, "%s: running\n", spec.name().c_str());
+        BenchClip(json, spec, path, options);
+        json.endObject();
+    }
+    json.endArray();
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage();
+        return -1;
+    }
+    MakeDirectory(options.dir);
+
+    Json json;
+    json.beginObject();
+    json.value("version", 1);
+    json.value("ffmpeg", FFmpegVersion());
+    json.value("quick", options.quick);
+    json.value("repeat", options.repeat);
+    json.value("seeks", options.seeks);
+    int result = 0;
+    if (options.camera) {
+        result = RunCamera(json, options.quick);
+    } else if (options.handoff) {
+        result = RunHandoff(json, options.quick);
+    } else if (options.kernels) {
+        result = RunKernels(json, options.quick);
+    } else if (options.verify) {
+        result = RunVerify(json, options.dir, options.quick, options.seeks);
+    } else if (options.scaling > 0) {
+        result = RunScalingMode(json, options);
+    } else {
+        result = RunSuite(json, options);
+    }
+    json.endObject();
+
+    std::string output = json.str() + "\n";
+    if (options.out.empty()) {
+        fwrite(output.data(), 1, output.size(), stdout);
+    } else if (!WriteFile(options.out, output)) {
+        fprintf(stderr, "could not write %s\n", options.out.c_str());
+        return -1;
+    }
+    return result;
+}
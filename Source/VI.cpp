@@ -3,49 +3,138 @@
 #include "videoInput.h"
 #elif __APPLE__
 #include "avfoundation.h"
+#elif __linux__
+#include "v4l2_camera.h"
+#include "virtual_camera.h"
 #endif
 #include "precomp.hpp"
 #include "utils.h"
+#include "trace.h"
 #include "videoio.hpp"
 #include <unordered_map>
 #include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <algorithm>
 
 namespace VI {
-String::String() {
-    m_data = new char[1];
-    m_data[0] = '\0';
-    m_size = 0;
-}
-String::String(const char* str, size_t size) {
-    if (size == 0) {
+String::String() : m_size(0) { m_local[0] = '\0'; }
+String::String(const char* str, size_t size) : m_size(0) {
+    if (size == 0 && str) {
         size = strlen(str);
     }
-    m_size = size;
-    m_data = new char[m_size + 1];
-    memcpy(m_data, str, m_size);
-    m_data[m_size] = '\0';
+    assign(str, size);
 }
-String::String(const String& str) {
-    m_size = str.m_size;
-    m_data = new char[m_size + 1];
-    memcpy(m_data, str.m_data, str.m_size);
-    m_data[m_size] = '\0';
+String::String(const String& str) : m_size(0) { assign(str.data(), str.m_size); }
+String::String(String&& str) noexcept : m_size(str.m_size) {
+    if (str.isLocal()) {
+        memcpy(m_local, str.m_local, LocalCapacity);
+    } else {
+        m_data = str.m_data;
+    }
+    str.m_size = 0;
+    str.m_local[0] = '\0';
+}
+String::~String() {
+    if (!isLocal()) delete[] m_data;
 }
-String::~String() { delete[] m_data; }
 String& String::operator=(const String& str) {
     if (this == &str) return *this;
-    delete[] m_data;
-    m_size = (str.m_size);
-    m_data = new char[m_size + 1];
-    memcpy(m_data, str.m_data, str.m_size);
-    m_data[m_size] = '\0';
+    if (!isLocal()) delete[] m_data;
+    m_size = 0;
+    assign(str.data(), str.m_size);
+    return *this;
+}
+String& String::operator=(String&& str) noexcept {
+    if (this == &str) return *this;
+    if (!isLocal()) delete[] m_data;
+    m_size = str.m_size;
+    if (str.isLocal()) {
+        memcpy(m_local, str.m_local, LocalCapacity);
+    } else {
+        m_data = str.m_data;
+    }
+    str.m_size = 0;
+    str.m_local[0] = '\0';
     return *this;
 }
-bool String::operator==(const char* str) { return m_size == strlen(str) ? strncmp(m_data, str, m_size) == 0 : false; }
-bool String::operator==(const String& str) { return m_size == str.m_size ? strncmp(m_data, str.m_data, m_size) == 0 : false; }
-const char* String::data() const { return m_data; }
+// Expects an empty (local) string.
+void String::assign(const char* str, size_t size) {
+    char* target = m_local;
+    if (size >= LocalCapacity) {
+        target = new char[size + 1];
+        m_data = target;
+    }
+    if (size) memcpy(target, str, size);
+    target[size] = '\0';
+    m_size = size;
+}
+// Compares at most size + 1 characters of str, its length is never computed separately.
+bool String::operator==(const char* str) const { return str && strncmp(data(), str, m_size) == 0 && str[m_size] == '\0'; }
+bool String::operator==(const String& str) const { return m_size == str.m_size && memcmp(data(), str.data(), m_size) == 0; }
+bool String::operator==(const char* str) { return static_cast<const String&>(*this) == str; }
+bool String::operator==(const String& str) { return static_cast<const String&>(*this) == str; }
+const char* String::data() const { return isLocal() ? m_local : m_data; }
 const size_t String::size() const { return m_size; }
 
+#if defined(_WIN32) || defined(__APPLE__) || defined(__linux__)
+
+struct CameraDelivery;
+static CameraDelivery& GetCameraDelivery(void* handle);
+// Blocks on the backend until a frame other than lastSequence arrives. timestampNs is its capture time,
+// sequence the frame it woke for.
+static bool WaitForCameraFrame(void* handle, uint64_t lastSequence, int timeoutMs, int64_t& timestampNs, uint64_t& sequence);
+// The last frame getPixels returned to the Camera.
+static uint64_t& GetCameraLastSequence(void* handle);
+
+// Wake-up latency and the optional listener thread of one Camera.
+struct CameraDelivery {
+    std::mutex latencyMutex;
+    LatencyHistogram latency;
+    std::thread thread;
+    std::atomic<bool> stop{false};
+    // the last frame onFrame was called for, owned by the listener thread: a listener that does not read
+    // every frame is still woken once per frame, and never reads the sequence getPixels updates
+    uint64_t delivered = 0;
+
+    ~CameraDelivery() { setListener(nullptr, nullptr, nullptr); }
+
+    bool wait(void* handle, uint64_t& lastSequence, int timeoutMs, int64_t& latencyNs) {
+        int64_t timestampNs;
+        if (!WaitForCameraFrame(handle, lastSequence, timeoutMs, timestampNs, lastSequence)) return false;
+        int64_t now = Utils::TraceNow();
+        if (Utils::TraceEnabled()) Utils::TraceEvent("camera_frame", timestampNs, now);
+        latencyNs = now - timestampNs;
+        std::lock_guard<std::mutex> lock(latencyMutex);
+        Utils::AddLatencySample(latency, latencyNs);
+        return true;
+    }
+
+    void setListener(Camera* camera, void* handle, CameraListener* listener) {
+        if (thread.joinable()) {
+            stop = true;
+            thread.join();
+        }
+        if (!listener) return;
+        stop = false;
+        delivered = 0;
+        thread = std::thread([this, camera, handle, listener]() {
+            while (!stop.load(std::memory_order_relaxed)) {
+                int64_t latencyNs;
+                // a short timeout, so that stopping never waits for a silent camera
+                if (wait(handle, delivered, 100, latencyNs)) listener->onFrame(*camera, latencyNs);
+            }
+        });
+    }
+};
+
+#endif
+
 #ifdef _WIN32
 
 std::unordered_map<int, uint32_t> GlobalDeviceUsage;
@@ -63,8 +152,25 @@ videoInput& GetGlobalVideoInput() {
 struct CameraInfo {
     int deviceID;
     bool bSuccess;
+    // last frame this Camera got, Cameras sharing a device each see every frame
+    uint64_t lastSequence = 0;
+    CameraDelivery delivery;
 };
 
+static CameraDelivery& GetCameraDelivery(void* handle) { return ((CameraInfo*)(handle))->delivery; }
+
+static uint64_t& GetCameraLastSequence(void* handle) { return ((CameraInfo*)(handle))->lastSequence; }
+
+static bool WaitForCameraFrame(void* handle, uint64_t lastSequence, int timeoutMs, int64_t& timestampNs, uint64_t& sequence) {
+    CameraInfo* info = (CameraInfo*)(handle);
+    if (info->bSuccess && info->deviceID >= 0 && GetGlobalVideoInput().isDeviceSetup(info->deviceID)) {
+        return GetGlobalVideoInput().waitForFrame(info->deviceID, lastSequence, timeoutMs, timestampNs, sequence);
+    }
+    // nothing is going to arrive, time out like a silent camera
+    std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+    return false;
+}
+
 void Camera::setVerbose(bool verbose) { videoInput::setVerbose(verbose); }
 void Camera::setComMultiThreaded(bool bMulti) { videoInput::setComMultiThreaded(bMulti); }
 
@@ -119,6 +225,7 @@ Camera::Camera(int deviceID, int width, int height, int fps) {
 
 Camera::~Camera() {
     if (m_handle) {
+        ((CameraInfo*)(m_handle))->delivery.setListener(nullptr, nullptr, nullptr);
         int deviceID = ((CameraInfo*)(m_handle))->deviceID;
         if (deviceID >= 0) {
             std::lock_guard<std::mutex> lk(GlobalDeviceUsageMutex);
@@ -137,12 +244,12 @@ Camera::~Camera() {
 }
 
 // Functions in rough order they should be used.
-LinkedList<String> Camera::getDeviceList() {
+Array<String> Camera::getDevices() {
     auto list = videoInput::getDeviceList();
-    LinkedList<String> result;
+    Array<String> result;
+    result.reserve(list.size());
     for (auto& item : list) {
-        String name(item.c_str(), item.size());
-        result.add(name);
+        result.add(String(item.c_str(), item.size()));
     }
     return result;
 }
@@ -180,7 +287,7 @@ bool Camera::getPixels(unsigned char* pixels, bool rgb, bool flipX, bool flipY)
     }
     int deviceID = ((CameraInfo*)(m_handle))->deviceID;
     if (deviceID >= 0) {
-        return GetGlobalVideoInput().getPixels(deviceID, pixels, rgb, flipX, !flipY);
+        return GetGlobalVideoInput().getPixels(deviceID, pixels, rgb, flipX, !flipY, ((CameraInfo*)(m_handle))->lastSequence);
     } else {
         return false;
     }
@@ -226,47 +333,258 @@ int Camera::getHeight() {
 }
 
 #elif __APPLE__
-LinkedList<String> Camera::getDeviceList() {
+Array<String> Camera::getDevices() {
     auto list = videoInput::getDeviceList();
-    LinkedList<String> result;
+    Array<String> result;
+    result.reserve(list.size());
     for (auto& item : list) {
-        String name(item.c_str(), item.size());
-        result.add(name);
+        result.add(String(item.c_str(), item.size()));
     }
     return result;
 }
 
-Camera::Camera(int deviceID) { m_handle = new videoInput(deviceID); }
+struct CameraInfo {
+    videoInput* input = nullptr;
+    // last frame getPixels returned
+    uint64_t lastSequence = 0;
+    CameraDelivery delivery;
+
+    ~CameraInfo() {
+        delivery.setListener(nullptr, nullptr, nullptr);
+        delete input;
+    }
+};
+
+static CameraDelivery& GetCameraDelivery(void* handle) { return ((CameraInfo*)(handle))->delivery; }
+
+static uint64_t& GetCameraLastSequence(void* handle) { return ((CameraInfo*)(handle))->lastSequence; }
+
+static bool WaitForCameraFrame(void* handle, uint64_t lastSequence, int timeoutMs, int64_t& timestampNs, uint64_t& sequence) {
+    videoInput* input = ((CameraInfo*)(handle))->input;
+    if (input->didStart()) {
+        return input->waitForFrame(lastSequence, timeoutMs, timestampNs, sequence);
+    }
+    // nothing is going to arrive, time out like a silent camera
+    std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+    return false;
+}
+
+Camera::Camera(int deviceID) {
+    auto info = new CameraInfo();
+    info->input = new videoInput(deviceID);
+    m_handle = info;
+}
 
 Camera::Camera(int deviceID, int width, int height, int fps) {
-    m_handle = new videoInput(deviceID);
-    ((videoInput*)(m_handle))->setProperty(CV_CAP_PROP_FRAME_WIDTH, width);
-    ((videoInput*)(m_handle))->setProperty(CV_CAP_PROP_FRAME_HEIGHT, height);
+    auto info = new CameraInfo();
+    info->input = new videoInput(deviceID);
+    info->input->setProperty(CV_CAP_PROP_FRAME_WIDTH, width);
+    info->input->setProperty(CV_CAP_PROP_FRAME_HEIGHT, height);
     if (fps) {
-        ((videoInput*)(m_handle))->setProperty(CV_CAP_PROP_FPS, fps);
+        info->input->setProperty(CV_CAP_PROP_FPS, fps);
     }
+    m_handle = info;
 }
 Camera::~Camera() {
     if (m_handle) {
-        delete (videoInput*)(m_handle);
+        delete (CameraInfo*)(m_handle);
         m_handle = NULL;
     }
 }
 bool Camera::getPixels(unsigned char* pixels, bool rgb, bool flipX, bool flipY) {
-    ((videoInput*)(m_handle))->retrieveFrame(pixels, rgb, flipX, flipY);
+    CameraInfo* info = (CameraInfo*)(m_handle);
+    info->input->retrieveLatestFrame(pixels, rgb, flipX, flipY, info->lastSequence);
     return true;
 }
 void Camera::showSettingsWindow() {}
-int Camera::getWidth() { return ((videoInput*)(m_handle))->getProperty(CV_CAP_PROP_FRAME_WIDTH); }
-int Camera::getHeight() { return ((videoInput*)(m_handle))->getProperty(CV_CAP_PROP_FRAME_HEIGHT); }
-bool Camera::isDeviceSetup() { return ((videoInput*)(m_handle))->didStart(); }
-bool Camera::isFrameNew() { return ((videoInput*)(m_handle))->grabFrame(); }
+int Camera::getWidth() { return ((CameraInfo*)(m_handle))->input->getProperty(CV_CAP_PROP_FRAME_WIDTH); }
+int Camera::getHeight() { return ((CameraInfo*)(m_handle))->input->getProperty(CV_CAP_PROP_FRAME_HEIGHT); }
+bool Camera::isDeviceSetup() { return ((CameraInfo*)(m_handle))->input->didStart(); }
+bool Camera::isFrameNew() { return ((CameraInfo*)(m_handle))->input->grabFrame(); }
+#elif __linux__
+
+struct VirtualDevice {
+    std::string name;
+    VirtualCamera::Params params;
+};
+std::vector<VirtualDevice> GlobalVirtualDevices;
+std::mutex GlobalVirtualDevicesMutex;
+
+// A V4L2 device streams to one process only once, Cameras opening it again share the stream.
+std::unordered_map<std::string, std::weak_ptr<V4L2Camera>> GlobalV4L2Devices;
+std::mutex GlobalV4L2DevicesMutex;
+
+struct CameraInfo {
+    // null when the device ID matched no device
+    std::shared_ptr<CameraSource> input;
+    // last frame this Camera got
+    uint64_t lastSequence = 0;
+    CameraDelivery delivery;
+
+    ~CameraInfo() { delivery.setListener(nullptr, nullptr, nullptr); }
+};
+
+static CameraDelivery& GetCameraDelivery(void* handle) { return ((CameraInfo*)(handle))->delivery; }
+
+static uint64_t& GetCameraLastSequence(void* handle) { return ((CameraInfo*)(handle))->lastSequence; }
+
+static bool WaitForCameraFrame(void* handle, uint64_t lastSequence, int timeoutMs, int64_t& timestampNs, uint64_t& sequence) {
+    CameraInfo* info = (CameraInfo*)(handle);
+    if (info->input && info->input->didStart()) {
+        return info->input->waitForFrame(lastSequence, timeoutMs, timestampNs, sequence);
+    }
+    // nothing is going to arrive, time out like a silent camera
+    std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+    return false;
+}
+
+// V4L2 devices by their index in the scan, virtual ones from Camera::VirtualDeviceBase on.
+static void* OpenCamera(int deviceID, int width, int height, int fps) {
+    auto info = new CameraInfo();
+    if (deviceID >= 0 && deviceID < Camera::VirtualDeviceBase) {
+        auto devices = V4L2Camera::ListDevices();
+        if (deviceID >= (int)devices.size()) return info;
+        std::lock_guard<std::mutex> lk(GlobalV4L2DevicesMutex);
+        auto& shared = GlobalV4L2Devices[devices[deviceID].path];
+        std::shared_ptr<V4L2Camera> camera = shared.lock();
+        if (!camera) {
+            camera = std::make_shared<V4L2Camera>(devices[deviceID].path, width, height, fps);
+            // a device that failed to start is retried by the next Camera
+            if (camera->start()) shared = camera;
+        }
+        info->input = camera;
+        return info;
+    }
+    deviceID -= Camera::VirtualDeviceBase;
+    VirtualCamera::Params params;
+    {
+        std::lock_guard<std::mutex> lk(GlobalVirtualDevicesMutex);
+        if (deviceID < 0 || deviceID >= (int)GlobalVirtualDevices.size()) return info;
+        params = GlobalVirtualDevices[deviceID].params;
+    }
+    if (width > 0 && height > 0) {
+        params.width = width;
+        params.height = height;
+    }
+    if (fps > 0) params.fps = fps;
+    info->input.reset(new VirtualCamera(params));
+    info->input->start();
+    return info;
+}
+
+int Camera::addVirtualDevice(const String& name, const VirtualCameraParams& params) {
+    VirtualDevice device;
+    device.name.assign(name.data(), name.size());
+    device.params.file.assign(params.file.data(), params.file.size());
+    device.params.width = params.width;
+    device.params.height = params.height;
+    device.params.fps = params.fps;
+    device.params.jitterMs = params.jitterMs;
+    std::lock_guard<std::mutex> lk(GlobalVirtualDevicesMutex);
+    GlobalVirtualDevices.push_back(std::move(device));
+    return VirtualDeviceBase + (int)GlobalVirtualDevices.size() - 1;
+}
+
+Array<String> Camera::getVirtualDevices() {
+    std::lock_guard<std::mutex> lk(GlobalVirtualDevicesMutex);
+    Array<String> result;
+    result.reserve(GlobalVirtualDevices.size());
+    for (auto& device : GlobalVirtualDevices) {
+        result.add(String(device.name.c_str(), device.name.size()));
+    }
+    return result;
+}
+
+Array<String> Camera::getDevices() {
+    auto devices = V4L2Camera::ListDevices();
+    Array<String> result;
+    result.reserve(devices.size());
+    for (auto& device : devices) {
+        result.add(String(device.name.c_str(), device.name.size()));
+    }
+    return result;
+}
+
+Camera::Camera(int deviceID) { m_handle = OpenCamera(deviceID, 0, 0, 0); }
+Camera::Camera(int deviceID, int width, int height, int fps) { m_handle = OpenCamera(deviceID, width, height, fps); }
+Camera::~Camera() {
+    if (m_handle) {
+        delete (CameraInfo*)(m_handle);
+        m_handle = NULL;
+    }
+}
+bool Camera::getPixels(unsigned char* pixels, bool rgb, bool flipX, bool flipY) {
+    CameraInfo* info = (CameraInfo*)(m_handle);
+    return info->input && info->input->getPixels(pixels, rgb, flipX, flipY, info->lastSequence);
+}
+void Camera::showSettingsWindow() {}
+int Camera::getWidth() { return ((CameraInfo*)(m_handle))->input ? ((CameraInfo*)(m_handle))->input->getWidth() : 0; }
+int Camera::getHeight() { return ((CameraInfo*)(m_handle))->input ? ((CameraInfo*)(m_handle))->input->getHeight() : 0; }
+bool Camera::isDeviceSetup() { return ((CameraInfo*)(m_handle))->input && ((CameraInfo*)(m_handle))->input->didStart(); }
+bool Camera::isFrameNew() {
+    CameraInfo* info = (CameraInfo*)(m_handle);
+    return info->input && info->input->isFrameNew(info->lastSequence);
+}
+#endif
+
+#if defined(_WIN32) || defined(__APPLE__) || defined(__linux__)
+bool Camera::waitForFrame(int timeoutMs) {
+    int64_t latencyNs;
+    // waits for a frame getPixels has not returned yet, on the caller's thread like getPixels itself;
+    // the frame stays the next one getPixels returns, so a copy of the sequence is waited on
+    uint64_t lastSequence = GetCameraLastSequence(m_handle);
+    return GetCameraDelivery(m_handle).wait(m_handle, lastSequence, timeoutMs, latencyNs);
+}
+
+LinkedList<String> Camera::getDeviceList() { return LinkedList<String>(getDevices()); }
+
+void Camera::setFrameListener(CameraListener* listener) { GetCameraDelivery(m_handle).setListener(this, m_handle, listener); }
+
+LatencyHistogram Camera::getDeliveryLatency() {
+    CameraDelivery& delivery = GetCameraDelivery(m_handle);
+    std::lock_guard<std::mutex> lock(delivery.latencyMutex);
+    return delivery.latency;
+}
 #endif
 
-Video::Video(const String& file) {
-    VideoCaptureParameters params;
-    // params.add(CAP_PROP_HW_ACCELERATION, VIDEO_ACCELERATION_ANY);
-    std::string path = file.data();
+static VideoCaptureParameters ToCaptureParameters(const VideoParams& params) {
+    VideoCaptureParameters captureParams;
+    if (params.hwAcceleration) {
+        captureParams.add(CAP_PROP_HW_ACCELERATION, VIDEO_ACCELERATION_ANY);
+    }
+    if (params.openTimeoutMs > 0) {
+        captureParams.add(CAP_PROP_OPEN_TIMEOUT_MSEC, params.openTimeoutMs);
+    }
+    if (params.readTimeoutMs > 0) {
+        captureParams.add(CAP_PROP_READ_TIMEOUT_MSEC, params.readTimeoutMs);
+    }
+    if (params.probeSize > 0) {
+        captureParams.add(CAP_PROP_PROBE_SIZE, params.probeSize);
+    }
+    if (params.analyzeDurationUs > 0) {
+        captureParams.add(CAP_PROP_ANALYZE_DURATION_USEC, params.analyzeDurationUs);
+    }
+    if (params.trustContainerHeader) {
+        captureParams.add(CAP_PROP_TRUST_CONTAINER_HEADER, 1);
+    }
+    if (params.inputFormat.size()) {
+        captureParams.addOption("input_format", params.inputFormat.data());
+    }
+    if (params.decoder.size()) {
+        captureParams.addOption("video_codec", params.decoder.data());
+    }
+    if (params.hugePages) {
+        captureParams.add(CAP_PROP_OUTPUT_HUGE_PAGES, 1);
+    }
+    if (params.decoderThreads > 0) {
+        captureParams.add(CAP_PROP_DECODER_THREADS, params.decoderThreads);
+    }
+    captureParams.setFrameAllocator(params.frameAllocator);
+    return captureParams;
+}
+
+static std::string ToCapturePath(const char* file) {
+    std::string path = file;
 #if _WIN32
     for (auto& chr : path) {
         if (chr == '\\') {
@@ -274,10 +592,30 @@ Video::Video(const String& file) {
         }
     }
 #endif
-    m_handle = cvCreateFileCapture_FFMPEG_proxy(path.c_str(), params);
-    seekTime(0);
+    return path;
+}
+
+static IVideoCapture* CreateVideoCapture(const String& file, const VideoParams& params, const std::atomic<bool>* interrupt) {
+    Utils::TraceScope trace("open");
+    VideoCaptureParameters captureParams = ToCaptureParameters(params);
+    captureParams.setInterruptFlag(interrupt);
+    IVideoCapture* capture = cvCreateFileCapture_FFMPEG_proxy(ToCapturePath(file.data()), captureParams);
+    if (capture) {
+        capture->seek(0.0);
+        // the flag belongs to the caller, it must not outlive the open
+        capture->setInterruptFlag(nullptr);
+    }
+    return capture;
 }
 
+Video::Video(const String& file) : Video(file, VideoParams()) {}
+
+Video::Video(const String& file, const VideoParams& params) { m_handle = CreateVideoCapture(file, params, nullptr); }
+
+Video::Video(Video&& video) : m_handle(video.m_handle) { video.m_handle = nullptr; }
+
+Video::Video(void* handle) : m_handle(handle) {}
+
 Video::~Video() {
     if (m_handle) {
         delete (IVideoCapture*)(m_handle);
@@ -285,6 +623,8 @@ Video::~Video() {
     }
 }
 
+bool Video::isOpened() { return m_handle ? ((IVideoCapture*)(m_handle))->isOpened() : false; }
+
 int64_t Video::getFramesCount() { return m_handle ? ((IVideoCapture*)(m_handle))->getProperty(CAP_PROP_FRAME_COUNT) : 0; }
 double Video::getTotalTime() {
     auto fps = getFPS();
@@ -310,18 +650,450 @@ void Video::seekTime(double sec) {
     }
 }
 
-bool Video::retrieveFrame(double sec, unsigned char** data, bool rgb) {
+VideoStats Video::getStats() {
+    VideoStats stats;
+    if (m_handle) {
+        ((IVideoCapture*)(m_handle))->getStats(stats);
+    }
+    return stats;
+}
+
+static bool DeliverSample(SampleListener* listener, int64_t index, double sec, const VideoFrame& frame) {
+    Utils::TraceScope trace("deliver", index);
+    return listener->onSample(index, sec, frame);
+}
+
+bool Video::grab() { return m_handle ? ((IVideoCapture*)(m_handle))->grabFrame() : false; }
+
+int64_t Video::skip(int64_t count) {
+    int64_t skipped = 0;
+    while (skipped < count && grab()) {
+        skipped++;
+    }
+    return skipped;
+}
+
+bool Video::grabAt(double sec) { return m_handle ? ((IVideoCapture*)(m_handle))->grabFrameAt(sec) : false; }
+
+int64_t Video::sample(double fps, SampleListener* listener, bool rgb) {
+    if (!m_handle || fps <= 0 || !listener) return 0;
+    double start = getCurrentTime();
+    int64_t count = 0;
+    VideoFrame frame;
+    int64_t frame_position = -1;
+    for (int64_t index = 0;; index++) {
+        double sec = start + index / fps;
+        if (!grabAt(sec)) break;
+        // a repeated frame is handed out again without converting it twice
+        int64_t position = getCurrentFrame();
+        if (position != frame_position || frame.empty()) {
+            if (!retrieve(frame, rgb)) break;
+            frame_position = position;
+        }
+        count++;
+        if (!DeliverSample(listener, index, sec, frame)) break;
+    }
+    return count;
+}
+
+int64_t Video::sampleEvery(int64_t stride, SampleListener* listener, bool rgb) { return stride > 0 ? sample(getFPS() / stride, listener, rgb) : 0; }
+
+bool Video::retrieveFrame(double sec, unsigned char** data, bool rgb) { return data && retrieveFrameInto(sec, *data, getWidth() * 3, rgb ? PixelFormat::RGB24 : PixelFormat::BGR24); }
+
+static int BytesPerPixel(PixelFormat format) {
+    switch (format) {
+        case PixelFormat::BGR24:
+        case PixelFormat::RGB24: return 3;
+        case PixelFormat::BGRA:
+        case PixelFormat::RGBA: return 4;
+        case PixelFormat::GRAY8: return 1;
+        default: return 0;
+    }
+}
+
+bool Video::retrieveFrameInto(double sec, unsigned char* dst, int stride, PixelFormat format) {
+    seekTime(sec);
+    return retrieve(dst, stride, format);
+}
+
+bool Video::retrieve(unsigned char* dst, int stride, PixelFormat format) {
+    int bpp = BytesPerPixel(format);
+    if (m_handle && dst && bpp && stride >= getWidth() * bpp) {
+        return ((IVideoCapture*)(m_handle))->retrieveFrameInto(dst, stride, format);
+    }
+    return false;
+}
+
+typedef IVideoCapturePlanes VideoFrameData;
+
+bool Video::retrieveFrame(double sec, VideoFrame& frame, bool rgb) {
+    seekTime(sec);
+    return retrieve(frame, rgb);
+}
+
+bool Video::retrieve(VideoFrame& frame, bool rgb) {
+    frame.release();
+    if (m_handle) {
+        IVideoCaptureFrame captured;
+        if (((IVideoCapture*)(m_handle))->retrieveFrame(0, captured, rgb)) {
+            auto buffer = ((IVideoCapture*)(m_handle))->refFrameBuffer();
+            if (!buffer) return false;
+            auto data = new VideoFrameData();
+            data->data[0] = captured.data;
+            data->step[0] = captured.step;
+            data->planes = 1;
+            data->width = captured.width;
+            data->height = captured.height;
+            data->cn = captured.cn;
+            data->format = rgb ? PixelFormat::RGB24 : PixelFormat::BGR24;
+            data->buffer = buffer;
+            frame.m_handle = data;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Video::retrieveDecoded(double sec, VideoFrame& frame) {
+    frame.release();
     if (m_handle) {
-        IVideoCaptureFrame frame;
-        ((IVideoCapture*)(m_handle))->getProperty(CAP_PROP_POS_MSEC);
+        auto data = new VideoFrameData();
         ((IVideoCapture*)(m_handle))->seek(sec);
-        if (((IVideoCapture*)(m_handle))->retrieveFrame(0, frame, rgb)) {
-            memcpy(*data, frame.data, frame.width * frame.height * 3 * sizeof(char));
+        if (((IVideoCapture*)(m_handle))->retrieveDecoded(*data)) {
+            frame.m_handle = data;
             return true;
         }
+        delete data;
     }
     return false;
 }
 
+VideoFrame::VideoFrame() : m_handle(nullptr) {}
+
+VideoFrame::VideoFrame(const VideoFrame& frame) : m_handle(frame.m_handle ? new VideoFrameData(*(VideoFrameData*)(frame.m_handle)) : nullptr) {}
+
+VideoFrame::VideoFrame(VideoFrame&& frame) : m_handle(frame.m_handle) { frame.m_handle = nullptr; }
+
+VideoFrame::~VideoFrame() { release(); }
+
+VideoFrame& VideoFrame::operator=(const VideoFrame& frame) {
+    if (this != &frame) {
+        release();
+        m_handle = frame.m_handle ? new VideoFrameData(*(VideoFrameData*)(frame.m_handle)) : nullptr;
+    }
+    return *this;
+}
+
+VideoFrame& VideoFrame::operator=(VideoFrame&& frame) {
+    if (this != &frame) {
+        release();
+        m_handle = frame.m_handle;
+        frame.m_handle = nullptr;
+    }
+    return *this;
+}
+
+bool VideoFrame::empty() const { return m_handle == nullptr; }
+int VideoFrame::getWidth() const { return m_handle ? ((VideoFrameData*)(m_handle))->width : 0; }
+int VideoFrame::getHeight() const { return m_handle ? ((VideoFrameData*)(m_handle))->height : 0; }
+int VideoFrame::getChannels() const { return m_handle ? ((VideoFrameData*)(m_handle))->cn : 0; }
+PixelFormat VideoFrame::getFormat() const { return m_handle ? ((VideoFrameData*)(m_handle))->format : PixelFormat::Unknown; }
+int VideoFrame::getStride() const { return getPlaneStride(0); }
+const unsigned char* VideoFrame::getData() const { return getPlaneData(0); }
+int VideoFrame::getPlaneCount() const { return m_handle ? ((VideoFrameData*)(m_handle))->planes : 0; }
+int VideoFrame::getPlaneStride(int plane) const { return plane >= 0 && plane < getPlaneCount() ? ((VideoFrameData*)(m_handle))->step[plane] : 0; }
+const unsigned char* VideoFrame::getPlaneData(int plane) const { return plane >= 0 && plane < getPlaneCount() ? ((VideoFrameData*)(m_handle))->data[plane] : nullptr; }
+
+void VideoFrame::release() {
+    if (m_handle) {
+        delete (VideoFrameData*)(m_handle);
+        m_handle = nullptr;
+    }
+}
+
+struct ExtractedFrame {
+    int64_t index;
+    double sec;
+    VideoFrame frame;
+};
+
+struct ExtractSegment {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<ExtractedFrame> frames;
+    bool done = false;
+};
+
+int64_t Video::extractParallel(const String& file, SampleListener* listener, int threads, bool ordered, bool rgb, const VideoParams& params) {
+    if (!listener) return 0;
+    if (threads <= 0) {
+        threads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    // frames each segment may queue ahead of the consumer
+    const size_t queueDepth = 8;
+
+    std::vector<int64_t> starts;
+    {
+        Video index(CreateVideoCapture(file, params, nullptr));
+        // a few segments per thread keeps the workers busy when segments differ in cost
+        if (!index.m_handle || !((IVideoCapture*)(index.m_handle))->getSegments(threads * 4, starts)) return 0;
+    }
+    threads = std::min(threads, (int)starts.size());
+
+    // the workers share the cores, one decoder thread each unless asked otherwise
+    VideoParams workerParams = params;
+    if (workerParams.decoderThreads <= 0) {
+        workerParams.decoderThreads = std::max(1, (int)std::thread::hardware_concurrency() / threads);
+    }
+
+    std::vector<std::unique_ptr<ExtractSegment>> segments;
+    for (size_t i = 0; i < starts.size(); i++) {
+        segments.emplace_back(new ExtractSegment());
+    }
+    std::atomic<size_t> next{0};
+    std::atomic<bool> stop{false};
+    std::mutex listenerMutex;
+    int64_t delivered = 0;
+
+    auto worker = [&]() {
+        Video video(CreateVideoCapture(file, workerParams, nullptr));
+        for (size_t i = next++; i < segments.size(); i = next++) {
+            ExtractSegment& segment = *segments[i];
+            if (video.m_handle && !stop) {
+                int64_t end = i + 1 < starts.size() ? starts[i + 1] : -1;
+                ((IVideoCapture*)(video.m_handle))->decodeSegment(starts[i], end, [&](int64_t index, double sec) {
+                    ExtractedFrame extracted{index, sec, VideoFrame()};
+                    if (!video.retrieve(extracted.frame, rgb)) return !stop;
+                    if (ordered) {
+                        std::unique_lock<std::mutex> lock(segment.mutex);
+                        segment.cond.wait(lock, [&]() { return segment.frames.size() < queueDepth || stop; });
+                        if (stop) return false;
+                        segment.frames.push_back(std::move(extracted));
+                        segment.cond.notify_all();
+                    } else {
+                        std::lock_guard<std::mutex> lock(listenerMutex);
+                        if (stop) return false;
+                        delivered++;
+                        if (!DeliverSample(listener, extracted.index, extracted.sec, extracted.frame)) stop = true;
+                    }
+                    return !stop;
+                });
+            }
+            std::lock_guard<std::mutex> lock(segment.mutex);
+            segment.done = true;
+            segment.cond.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(worker);
+    }
+
+    if (ordered) {
+        for (size_t i = 0; i < segments.size() && !stop; i++) {
+            ExtractSegment& segment = *segments[i];
+            for (;;) {
+                std::unique_lock<std::mutex> lock(segment.mutex);
+                segment.cond.wait(lock, [&]() { return !segment.frames.empty() || segment.done; });
+                if (segment.frames.empty()) break;
+                ExtractedFrame extracted = std::move(segment.frames.front());
+                segment.frames.pop_front();
+                segment.cond.notify_all();
+                lock.unlock();
+                delivered++;
+                if (!DeliverSample(listener, extracted.index, extracted.sec, extracted.frame)) {
+                    stop = true;
+                    break;
+                }
+            }
+        }
+        if (stop) {
+            // wake the workers blocked on a full segment
+            for (auto& segment : segments) {
+                std::lock_guard<std::mutex> lock(segment->mutex);
+                segment->cond.notify_all();
+            }
+        }
+    }
+
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    return delivered;
+}
+
+struct AsyncOpenState {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::thread worker;
+    std::atomic<bool> cancelled{false};
+    bool ready = false;
+    IVideoCapture* capture = nullptr;
+};
+
+VideoFuture Video::openAsync(const String& file, const VideoParams& params, VideoOpenListener* listener) {
+    auto state = new AsyncOpenState();
+    state->worker = std::thread([state, file, params, listener]() {
+        IVideoCapture* capture = state->cancelled ? nullptr : CreateVideoCapture(file, params, &state->cancelled);
+        if (capture && state->cancelled) {
+            delete capture;
+            capture = nullptr;
+        }
+        {
+            std::lock_guard<std::mutex> lk(state->mutex);
+            state->capture = capture;
+            state->ready = true;
+        }
+        state->cond.notify_all();
+        if (listener) {
+            listener->onOpenComplete(capture != nullptr);
+        }
+    });
+    return VideoFuture(state);
+}
+
+VideoFuture::VideoFuture(void* handle) : m_handle(handle) {}
+
+VideoFuture::VideoFuture(VideoFuture&& future) : m_handle(future.m_handle) { future.m_handle = nullptr; }
+
+VideoFuture::~VideoFuture() {
+    if (m_handle) {
+        auto state = (AsyncOpenState*)(m_handle);
+        state->cancelled = true;
+        if (state->worker.joinable()) {
+            state->worker.join();
+        }
+        delete state->capture;
+        delete state;
+        m_handle = nullptr;
+    }
+}
+
+bool VideoFuture::isReady() {
+    if (!m_handle) return false;
+    auto state = (AsyncOpenState*)(m_handle);
+    std::lock_guard<std::mutex> lk(state->mutex);
+    return state->ready;
+}
+
+bool VideoFuture::wait(int timeoutMs) {
+    if (!m_handle) return false;
+    auto state = (AsyncOpenState*)(m_handle);
+    std::unique_lock<std::mutex> lk(state->mutex);
+    if (timeoutMs < 0) {
+        state->cond.wait(lk, [state]() { return state->ready; });
+    } else {
+        state->cond.wait_for(lk, std::chrono::milliseconds(timeoutMs), [state]() { return state->ready; });
+    }
+    return state->ready;
+}
+
+void VideoFuture::cancel() {
+    if (m_handle) {
+        ((AsyncOpenState*)(m_handle))->cancelled = true;
+    }
+}
+
+bool VideoFuture::isCancelled() { return m_handle ? ((AsyncOpenState*)(m_handle))->cancelled.load() : false; }
+
+Video VideoFuture::get() {
+    if (!m_handle) return Video((void*)nullptr);
+    wait();
+    auto state = (AsyncOpenState*)(m_handle);
+    std::lock_guard<std::mutex> lk(state->mutex);
+    IVideoCapture* capture = state->capture;
+    state->capture = nullptr;
+    return Video(capture);
+}
+
+static bool ProbeFile(const char* file, const VideoParams& params, VideoInfo& info) {
+    VideoProbeResult result;
+    if (!cvProbeFile_FFMPEG_proxy(ToCapturePath(file), ToCaptureParameters(params), result)) {
+        return false;
+    }
+    info.width = result.width;
+    info.height = result.height;
+    info.fps = result.fps;
+    info.duration = result.duration;
+    info.framesCount = result.frames;
+    info.bitRate = result.bitrate;
+    info.codec = String(result.codec.c_str(), result.codec.size());
+    return true;
+}
+
+bool Probe(const String& file, VideoInfo& info, const VideoParams& params) { return ProbeFile(file.data(), params, info); }
+
+static ScanSummary ScanFiles(const std::vector<std::string>& files, ProbeListener* listener, int threads, const VideoParams& params) {
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> probed{0};
+    std::mutex listenerMutex;
+    auto worker = [&]() {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            VideoInfo info;
+            bool success = ProbeFile(files[i].c_str(), params, info);
+            if (success) probed++;
+            if (listener) {
+                std::lock_guard<std::mutex> lk(listenerMutex);
+                listener->onProbe(String(files[i].c_str(), files[i].size()), success, info);
+            }
+        }
+    };
+    size_t count = threads > 0 ? (size_t)threads : std::max(1u, std::thread::hardware_concurrency());
+    count = std::min(count, files.size());
+    std::vector<std::thread> pool;
+    for (size_t i = 0; i < count; i++) {
+        pool.emplace_back(worker);
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    ScanSummary summary;
+    summary.files = files.size();
+    summary.probed = probed;
+    summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    summary.filesPerSecond = summary.seconds > 0 ? (double)summary.files / summary.seconds : 0;
+    return summary;
+}
+
+ScanSummary ScanVideos(const String* files, size_t count, ProbeListener* listener, int threads, const VideoParams& params) {
+    std::vector<std::string> list;
+    list.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        list.emplace_back(files[i].data(), files[i].size());
+    }
+    return ScanFiles(list, listener, threads, params);
+}
+
+ScanSummary ScanDirectory(const String& directory, ProbeListener* listener, bool recursive, int threads, const VideoParams& params) {
+    return ScanFiles(Utils::ListDirectory(directory.data(), recursive), listener, threads, params);
+}
+
+void SetDecoderPoolCapacity(size_t capacity) { cvSetDecoderPoolCapacity_FFMPEG_proxy(capacity); }
+
+DecoderPoolStats GetDecoderPoolStats() {
+    DecoderPoolCounters counters = cvGetDecoderPoolStats_FFMPEG_proxy();
+    DecoderPoolStats stats;
+    stats.hits = counters.hits;
+    stats.misses = counters.misses;
+    stats.evictions = counters.evictions;
+    stats.idle = counters.idle;
+    stats.capacity = counters.capacity;
+    return stats;
+}
+
 void SetGlobalLogger(Logger* logger) { Utils::SetGlobalLogger(logger); }
+
+void SetLogLevel(LogLevel level) { Utils::SetLogLevel(level); }
+
+void SetAsyncLogging(bool enabled) { Utils::SetAsyncLogging(enabled); }
+
+void FlushLog() { Utils::FlushLog(); }
+
+void EnableTracing(bool enabled) { Utils::SetTraceEnabled(enabled); }
+
+void ClearTrace() { Utils::ClearTrace(); }
+
+bool DumpTrace(const String& path) { return Utils::DumpTrace(std::string(path.data(), path.size())); }
 }  // namespace VI
@@ -19,9 +19,119 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <new>
 
 namespace VI {
 
+// Contiguous growable array for public results: O(1) indexing, iteration over plain pointers and move
+// semantics. Header-only like LinkedList so element types only need to be copyable or movable.
+template <typename T>
+class Array {
+public:
+    Array() : _data(nullptr), _size(0), _capacity(0) {}
+    Array(const Array<T>& array) : _data(nullptr), _size(0), _capacity(0) {
+        reserve(array._size);
+        for (size_t i = 0; i < array._size; i++) new (_data + i) T(array._data[i]);
+        _size = array._size;
+    }
+    Array(Array<T>&& array) noexcept : _data(array._data), _size(array._size), _capacity(array._capacity) {
+        array._data = nullptr;
+        array._size = array._capacity = 0;
+    }
+    Array& operator=(const Array<T>& array) {
+        if (this != &array) {
+            Array<T> copy(array);
+            *this = static_cast<Array<T>&&>(copy);
+        }
+        return *this;
+    }
+    Array& operator=(Array<T>&& array) noexcept {
+        if (this != &array) {
+            clear();
+            ::operator delete(_data);
+            _data = array._data;
+            _size = array._size;
+            _capacity = array._capacity;
+            array._data = nullptr;
+            array._size = array._capacity = 0;
+        }
+        return *this;
+    }
+    ~Array() {
+        clear();
+        ::operator delete(_data);
+    }
+
+    size_t size() const { return _size; }
+    size_t capacity() const { return _capacity; }
+    bool empty() const { return _size == 0; }
+
+    void reserve(size_t capacity) {
+        if (capacity <= _capacity) return;
+        T* data = static_cast<T*>(::operator new(capacity * sizeof(T)));
+        for (size_t i = 0; i < _size; i++) {
+            new (data + i) T(static_cast<T&&>(_data[i]));
+            _data[i].~T();
+        }
+        ::operator delete(_data);
+        _data = data;
+        _capacity = capacity;
+    }
+    void resize(size_t size) {
+        reserve(size);
+        while (_size < size) new (_data + _size++) T();
+        while (_size > size) _data[--_size].~T();
+    }
+    void clear() {
+        while (_size > 0) _data[--_size].~T();
+    }
+
+    void add(const T& value) {
+        if (_size == _capacity) {
+            // value may live in this array
+            T copy(value);
+            grow();
+            new (_data + _size++) T(static_cast<T&&>(copy));
+        } else {
+            new (_data + _size++) T(value);
+        }
+    }
+    void add(T&& value) {
+        if (_size == _capacity) grow();
+        new (_data + _size++) T(static_cast<T&&>(value));
+    }
+    T remove(size_t index) {
+        assert(index < _size);
+        T value(static_cast<T&&>(_data[index]));
+        for (size_t i = index + 1; i < _size; i++) _data[i - 1] = static_cast<T&&>(_data[i]);
+        _data[--_size].~T();
+        return value;
+    }
+
+    T& operator[](size_t index) {
+        assert(index < _size);
+        return _data[index];
+    }
+    const T& operator[](size_t index) const {
+        assert(index < _size);
+        return _data[index];
+    }
+    T* data() { return _data; }
+    const T* data() const { return _data; }
+    T* begin() { return _data; }
+    T* end() { return _data + _size; }
+    const T* begin() const { return _data; }
+    const T* end() const { return _data + _size; }
+
+private:
+    void grow() { reserve(_capacity ? _capacity * 2 : 4); }
+
+    T* _data;
+    size_t _size;
+    size_t _capacity;
+};
+
+// Deprecated, kept for compatibility: new public functions return Array, which converts to LinkedList.
 template <typename T>
 class LinkedList {
 private:
@@ -36,7 +146,7 @@ private:
         ListNode(const ListNode& node) : _next(node._next), _prev(node._prev), _value(node._value) {}
         ListNode(ListNode&& node) : _next(node._next), _prev(node._prev), _value(node._value) { node._next = node._prev = nullptr; }
         ListNode(const T& value) : _value(value), _next(nullptr), _prev(nullptr) {}
-        ListNode(T&& value) : _value(value), _next(nullptr), _prev(nullptr) {}
+        ListNode(T&& value) : _value(static_cast<T&&>(value)), _next(nullptr), _prev(nullptr) {}
         ListNode& operator=(const T& value) {
             _value = value;
             return *this;
@@ -86,8 +196,13 @@ public:
     };
     LinkedList() : _head(nullptr), _tail(nullptr), _size(0) {}
     LinkedList(const LinkedList<T>& list) : _head(nullptr), _tail(nullptr), _size(0) {
-        for (size_t i = 0; i < list.size(); i++) {
-            add(list[i]);
+        for (ListNode* node = list._head; node != nullptr; node = node->_next) {
+            add(node->_value);
+        }
+    }
+    LinkedList(const Array<T>& array) : _head(nullptr), _tail(nullptr), _size(0) {
+        for (const T& value : array) {
+            add(value);
         }
     }
     LinkedList(LinkedList<T>&& list) : _head(list._head), _tail(list._tail), _size(list._size) {
@@ -95,9 +210,10 @@ public:
         list._size = 0;
     }
     LinkedList& operator=(const LinkedList<T>& list) {
+        if (this == &list) return *this;
         clear();
-        for (size_t i = 0; i < list.size(); i++) {
-            add(list[i]);
+        for (ListNode* node = list._head; node != nullptr; node = node->_next) {
+            add(node->_value);
         }
         return *this;
     }
@@ -227,24 +343,81 @@ public:
     }
 };
 
+// Non-owning view of characters, valid as long as the String it came from is alive and unmodified.
+struct StringView {
+    const char* data;
+    size_t size;
+};
+
+// UTF-8 string. Strings shorter than sizeof(char*) are stored inline, so the object keeps the size
+// of a pointer plus a length.
 class VI_PORT String {
 public:
     String();
     String(const char* str, size_t size = 0);
     String(const String& str);
+    String(String&& str) noexcept;
     ~String();
     String& operator=(const String& str);
+    String& operator=(String&& str) noexcept;
     bool operator==(const char* str);
     bool operator==(const String& str);
+    bool operator==(const char* str) const;
+    bool operator==(const String& str) const;
+    bool operator!=(const char* str) const { return !(*this == str); }
+    bool operator!=(const String& str) const { return !(*this == str); }
     const char* data() const;
     const size_t size() const;
+    bool empty() const { return m_size == 0; }
+    StringView view() const { return StringView{data(), m_size}; }
 
 private:
-    char* m_data;
+    static const size_t LocalCapacity = sizeof(char*);
+    bool isLocal() const { return m_size < LocalCapacity; }
+    void assign(const char* str, size_t size);
+
+    union {
+        char* m_data;
+        char m_local[LocalCapacity];
+    };
     size_t m_size;
 };
 
 template class VI_PORT LinkedList<String>;
+template class VI_PORT Array<String>;
+
+struct VI_PORT LatencyHistogram {
+public:
+    // Bucket i counts samples in [2^i, 2^(i+1)) nanoseconds, the last bucket everything above.
+    static const int BucketCount = 40;
+    uint64_t count = 0;
+    uint64_t totalNs = 0;
+    uint64_t maxNs = 0;
+    uint64_t buckets[BucketCount] = {};
+};
+
+class Camera;
+
+#if defined(__linux__)
+struct VI_PORT VirtualCameraParams {
+public:
+    // Played in a loop at its own size, empty for a generated test pattern.
+    String file;
+    int width = 640;
+    int height = 480;
+    // 0 plays a file at its own frame rate.
+    double fps = 30;
+    // Standard deviation of each delivery around its nominal time, kept within half a frame period.
+    double jitterMs = 1;
+};
+#endif
+
+struct VI_PORT CameraListener {
+public:
+    // Called on the Camera's delivery thread as soon as a frame arrives, getPixels returns it without waiting.
+    // The second argument is the time in ns from the capture callback to this call.
+    void virtual onFrame(Camera&, int64_t){};
+};
 
 class VI_PORT Camera {
 public:
@@ -252,7 +425,21 @@ public:
     Camera(int deviceID, int width, int height, int fps = 0);
     ~Camera();
 
-    static LinkedList<String> getDeviceList();
+    // Capture device names, indexed by device ID.
+    static Array<String> getDevices();
+    // The same list as getDevices, kept with its original signature for existing callers and binaries.
+    [[deprecated("use Camera::getDevices")]] static LinkedList<String> getDeviceList();
+
+#if defined(__linux__)
+    // Virtual devices take the IDs VirtualDeviceBase, VirtualDeviceBase + 1, ... in registration order, apart
+    // from the V4L2 devices listed by getDevices, so a camera plugged in or out never moves them.
+    static const int VirtualDeviceBase = 1000;
+    // Registers a camera without hardware that plays a file or generates a pattern, for CI and load tests.
+    // Returns its device ID.
+    static int addVirtualDevice(const String& name, const VirtualCameraParams& params);
+    // Names of the virtual devices, indexed by device ID - VirtualDeviceBase.
+    static Array<String> getVirtualDevices();
+#endif
 
 #if defined(WIN32)
     static void setVerbose(bool verbose);
@@ -263,6 +450,17 @@ public:
     // specified setAutoReconnectOnFreeze to true
     bool isFrameNew();
 
+    // Blocks until a frame this Camera has not got yet arrives, false on timeout. The capture callback wakes
+    // the caller, there is no polling. getPixels then returns that frame without waiting.
+    bool waitForFrame(int timeoutMs = 1000);
+
+    // Calls listener->onFrame from a delivery thread for every new frame, nullptr stops the thread. While a
+    // listener is set, read the frames from onFrame only. Not to be called from inside onFrame.
+    void setFrameListener(CameraListener* listener);
+
+    // Wake-up latency of waitForFrame and onFrame, from the capture callback.
+    LatencyHistogram getDeliveryLatency();
+
     bool isDeviceSetup();
 
     // Or pass in a buffer for getPixels to fill returns true if successful.
@@ -280,11 +478,118 @@ private:
     void* m_handle;
 };
 
+enum class VI_PORT PixelFormat { Unknown = 0, BGR24, RGB24, BGRA, RGBA, GRAY8, YUV420P, YUV422P, YUV444P, NV12 };
+
+// Supplies the memory decoders write into, e.g. pinned or shared memory.
+// It must outlive the Video and every frame decoded into it, calls may come from decoder threads.
+struct VI_PORT FrameAllocator {
+public:
+    // allocate(size, align) returns at least size bytes aligned to align, nullptr falls back to the FFmpeg
+    // allocator. release gets back what allocate returned.
+    virtual void* allocate(size_t, size_t) { return nullptr; }
+    virtual void release(void*) {}
+};
+
+struct VI_PORT VideoParams {
+public:
+    // Timeouts in milliseconds, 0 keeps the backend default.
+    int openTimeoutMs = 0;
+    int readTimeoutMs = 0;
+    bool hwAcceleration = false;
+
+    // Probing limits for stream analysis (bytes, microseconds), 0 keeps the FFmpeg defaults.
+    int probeSize = 0;
+    int analyzeDurationUs = 0;
+    // FFmpeg demuxer / decoder names (e.g. "mov", "h264"), empty lets FFmpeg detect them.
+    String inputFormat;
+    String decoder;
+    // Skip stream analysis when the container header already describes the video stream.
+    bool trustContainerHeader = false;
+    // Back the converted frames with transparent huge pages (Linux only).
+    bool hugePages = false;
+    // Decode into application memory, only used by software decoders supporting direct rendering.
+    FrameAllocator* frameAllocator = nullptr;
+    // Decoder threads, 0 uses one per core.
+    int decoderThreads = 0;
+};
+
+class VideoFuture;
+
+struct VI_PORT VideoOpenListener {
+public:
+    // Called on the opening thread once the open has finished, failed or was cancelled.
+    void virtual onOpenComplete(bool){};
+};
+
+// A converted frame. Copies share the pixels, which stay valid for as long as one copy is alive.
+class VI_PORT VideoFrame {
+public:
+    VideoFrame();
+    VideoFrame(const VideoFrame& frame);
+    VideoFrame(VideoFrame&& frame);
+    ~VideoFrame();
+    VideoFrame& operator=(const VideoFrame& frame);
+    VideoFrame& operator=(VideoFrame&& frame);
+
+    bool empty() const;
+    int getWidth() const;
+    int getHeight() const;
+    // 0 for planar formats.
+    int getChannels() const;
+    PixelFormat getFormat() const;
+    // Bytes per row, rows are padded so that each one starts 64-byte aligned.
+    int getStride() const;
+    const unsigned char* getData() const;
+    int getPlaneCount() const;
+    int getPlaneStride(int plane) const;
+    const unsigned char* getPlaneData(int plane) const;
+    void release();
+
+private:
+    friend class Video;
+    void* m_handle;
+};
+
+struct VI_PORT VideoStats {
+public:
+    uint64_t bytesRead = 0;       // payload of every demuxed packet
+    uint64_t packetsRead = 0;
+    uint64_t packetsSkipped = 0;  // packets of other streams
+    uint64_t decodeErrors = 0;
+    uint64_t decodeRetries = 0;   // decoder asked for more input (EAGAIN)
+    uint64_t framesDecoded = 0;
+    uint64_t seeks = 0;
+    LatencyHistogram demux;    // av_read_frame
+    LatencyHistogram decode;   // one packet sent and the frame received
+    LatencyHistogram seek;     // whole seek, including decoding up to the target
+    LatencyHistogram convert;  // colour conversion
+    LatencyHistogram copy;     // hardware frame download to system memory
+};
+
+struct VI_PORT SampleListener {
+public:
+    // Called for every sampled frame in order, return false to stop the extraction.
+    // The arguments are the sample's index, its time in seconds and the frame.
+    bool virtual onSample(int64_t, double, const VideoFrame&) { return true; }
+};
+
 class VI_PORT Video {
 public:
     Video(const String& file);
+    Video(const String& file, const VideoParams& params);
+    Video(Video&& video);
     ~Video();
 
+    // Opens the file on a background thread, the returned future owns the pending open.
+    static VideoFuture openAsync(const String& file, const VideoParams& params = VideoParams(), VideoOpenListener* listener = nullptr);
+
+    // Decodes every frame of a file on several threads, each one working on its own GOP-aligned segments.
+    // Ordered delivery calls the listener on the calling thread in frame order, unordered delivery calls it from
+    // the workers (serialized) as soon as a frame is ready. Returns the number of delivered frames.
+    static int64_t extractParallel(const String& file, SampleListener* listener, int threads = 0, bool ordered = true, bool rgb = false, const VideoParams& params = VideoParams());
+
+    bool isOpened();
+
     int64_t getFramesCount();
     double getTotalTime();
     double getFPS();
@@ -296,15 +601,117 @@ public:
     int getWidth();
     int getHeight();
 
+    // Counters since the open, reading them costs a copy of the struct.
+    VideoStats getStats();
+
     void seekFrame(int64_t frame_number);
     void seekTime(double sec);
 
+    // Demuxes and decodes the next frame without converting it.
+    bool grab();
+    // Converts the last grabbed (or sought) frame. dst receives getWidth() x getHeight() pixels, turned
+    // by the stream's rotation metadata; a VideoFrame holds the coded picture, unrotated, at its own size.
+    bool retrieve(unsigned char* dst, int stride, PixelFormat format = PixelFormat::BGR24);
+    bool retrieve(VideoFrame& frame, bool rgb = false);
+    // Decodes and drops the next count frames, returns how many were actually grabbed.
+    int64_t skip(int64_t count);
+
+    // Steps forward to the frame on screen at sec, nothing is converted and non-reference frames
+    // that end before sec are not decoded. Frames repeat or drop like with the fps filter.
+    bool grabAt(double sec);
+    // Constant-rate extraction from the current position: the frames on screen at start, start + 1 / fps, ...
+    // converted once each and handed to the listener. Returns the number of samples.
+    int64_t sample(double fps, SampleListener* listener, bool rgb = false);
+    // Every stride-th frame, same as sample(getFPS() / stride).
+    int64_t sampleEvery(int64_t stride, SampleListener* listener, bool rgb = false);
+
     bool retrieveFrame(double sec, unsigned char** data, bool rgb = false);
+    // Converts straight into dst (e.g. a mapped staging buffer), rows are stride bytes apart.
+    // Packed formats only (BGR24, RGB24, BGRA, RGBA, GRAY8), stride must hold at least one row.
+    bool retrieveFrameInto(double sec, unsigned char* dst, int stride, PixelFormat format = PixelFormat::BGR24);
+    // Zero-copy variant, the frame holds its own reference on a pooled buffer.
+    bool retrieveFrame(double sec, VideoFrame& frame, bool rgb = false);
+    // The decoded picture in the decoder's pixel format, without conversion or copy.
+    bool retrieveDecoded(double sec, VideoFrame& frame);
 
 private:
+    friend class VideoFuture;
+    Video(void* handle);
+    Video(const Video&) = delete;
+    Video& operator=(const Video&) = delete;
+
     void* m_handle;
 };
 
+class VI_PORT VideoFuture {
+public:
+    VideoFuture(VideoFuture&& future);
+    // Cancels a pending open and waits for the worker to stop.
+    ~VideoFuture();
+
+    bool isReady();
+    // Waits for the open to finish, a negative timeout waits forever. Returns isReady().
+    bool wait(int timeoutMs = -1);
+    // Aborts the pending open through the FFmpeg interrupt callback.
+    void cancel();
+    bool isCancelled();
+    // Waits for the open and hands over the result, check Video::isOpened() on the returned object.
+    Video get();
+
+private:
+    friend class Video;
+    VideoFuture(void* handle);
+    VideoFuture(const VideoFuture&) = delete;
+    VideoFuture& operator=(const VideoFuture&) = delete;
+
+    void* m_handle;
+};
+
+struct VI_PORT VideoInfo {
+public:
+    int width = 0;
+    int height = 0;
+    double fps = 0;
+    double duration = 0;  // seconds, 0 when the container does not say
+    int64_t framesCount = 0;  // 0 when unknown
+    int64_t bitRate = 0;  // kbits/s
+    String codec;
+};
+
+// Reads the container header only, no decoder is opened and no frame is decoded.
+bool VI_PORT Probe(const String& file, VideoInfo& info, const VideoParams& params = VideoParams());
+
+struct VI_PORT ProbeListener {
+public:
+    // Called for every file as soon as it is probed, calls are serialized across the scanner threads.
+    void virtual onProbe(const String&, bool, const VideoInfo&){};
+};
+
+struct VI_PORT ScanSummary {
+public:
+    size_t files = 0;
+    size_t probed = 0;
+    double seconds = 0;
+    double filesPerSecond = 0;
+};
+
+// Probe a list of files or every file of a directory on a bounded thread pool (0 threads uses one per core).
+ScanSummary VI_PORT ScanVideos(const String* files, size_t count, ProbeListener* listener, int threads = 0, const VideoParams& params = VideoParams());
+ScanSummary VI_PORT ScanDirectory(const String& directory, ProbeListener* listener, bool recursive = true, int threads = 0, const VideoParams& params = VideoParams());
+
+struct VI_PORT DecoderPoolStats {
+public:
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t idle = 0;
+    size_t capacity = 0;
+};
+
+// Keep up to capacity opened software decoders around for reuse by later opens with identical stream parameters, 0 (default) disables pooling.
+void VI_PORT SetDecoderPoolCapacity(size_t capacity);
+DecoderPoolStats VI_PORT GetDecoderPoolStats();
+
 enum class VI_PORT LogLevel { Debug = 1, Info = 2, Warning = 3, Error = 4 };
 
 struct VI_PORT Logger {
@@ -312,5 +719,25 @@ public:
     void virtual onMessage(LogLevel, const char*){};
 };
 
+// Messages still queued by asynchronous logging reach the previous logger before this returns, it can be freed
+// afterwards. Like FlushLog it never returns when called from onMessage while asynchronous logging is on.
 void VI_PORT SetGlobalLogger(Logger* logger);
+// Messages below level are dropped before they are formatted, Info by default.
+// Debug messages are compiled out of release builds unless the library is built with VI_DEBUG_LOG.
+void VI_PORT SetLogLevel(LogLevel level);
+// Deliver log messages from a background thread instead of the thread that logs them, so slow loggers
+// never stall decoding. Messages are dropped (and counted) when the queue is full. Disabling it delivers
+// what is queued and stops the thread, do that before unloading the library: on Windows the thread keeps
+// the DLL loaded until then.
+void VI_PORT SetAsyncLogging(bool enabled);
+// Waits until every queued message has reached the logger. Never call it from Logger::onMessage while
+// asynchronous logging is on: onMessage runs on the delivering thread, which would wait for itself forever.
+void VI_PORT FlushLog();
+
+// Records open, read_packet, decode, download, convert, seek and deliver spans of every thread into per-thread ring buffers,
+// disabled by default and costs a single flag check per span while off.
+void VI_PORT EnableTracing(bool enabled);
+void VI_PORT ClearTrace();
+// Writes the recorded spans as Chrome trace JSON, open it in chrome://tracing or ui.perfetto.dev.
+bool VI_PORT DumpTrace(const String& path);
 }  // namespace VI
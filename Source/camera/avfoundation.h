@@ -9,6 +9,10 @@
 #include <string>
 #include <vector>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "triple_buffer.h"
 
 struct IplImage {
     int nChannels;
@@ -33,10 +37,15 @@ struct IplImage {
  *****************************************************************************/
 
 @interface CaptureDelegate : NSObject <AVCaptureVideoDataOutputSampleBufferDelegate> {
-    std::mutex newFrameMutex;
-    bool mHasNewFrame;
+    // every slot owns one reference on its image buffer
+    TripleBuffer<CVImageBufferRef> mFrames;
     CVPixelBufferRef mGrabbedPixels;
-    CVImageBufferRef mCurrentImageBuffer;
+    uint64_t mGrabbedSequence;
+    // newest published frame, for the waiters; the capture thread only holds mWaitMutex to notify them
+    std::atomic<uint64_t> mLatestSequence;
+    std::atomic<int64_t> mLatestTimestampNs;
+    std::mutex mWaitMutex;
+    std::condition_variable mFrameArrived;
     IplImage* mDeviceImage;
     uint8_t* mOutImageData;
     uint8_t* mOutImageDataFlip;
@@ -46,6 +55,10 @@ struct IplImage {
 - (void)captureOutput:(AVCaptureOutput*)captureOutput didOutputSampleBuffer:(CMSampleBufferRef)sampleBuffer fromConnection:(AVCaptureConnection*)connection;
 
 - (BOOL)grabImageUntilDate;
+- (BOOL)waitForFrame:(int)timeoutMs after:(uint64_t)lastSequence;
+- (uint64_t)latestSequence;
+- (int64_t)latestTimestampNs;
+- (uint64_t)grabbedSequence;
 - (int)updateImage;
 - (void)getOutput:(uint8_t*)buffer forRGB:(bool)rgb forFlipX:(bool)flipX forFlipY:(bool)flipY;
 
@@ -67,7 +80,14 @@ public:
     videoInput(int cameraNum = -1);
     ~videoInput();
     bool grabFrame();
+    // Blocks until the capture callback publishes a frame other than lastSequence, false on timeout. Nothing is
+    // grabbed, the frame stays for the next grab. timestampNs receives its capture time (steady clock),
+    // sequence its sequence.
+    bool waitForFrame(uint64_t lastSequence, int timeoutMs, int64_t& timestampNs, uint64_t& sequence);
     void retrieveFrame(uint8_t* buffer, bool rgb, bool flipX, bool flipY);
+    // Grabs the newest frame if one arrived since the last grab, converts the grabbed image into buffer and
+    // sets lastSequence to its sequence.
+    void retrieveLatestFrame(uint8_t* buffer, bool rgb, bool flipX, bool flipY, uint64_t& lastSequence);
     double getProperty(PROPERTY property_id) const;
     bool setProperty(PROPERTY property_id, double value);
 
@@ -84,8 +104,13 @@ private:
     void stopCaptureDevice();
 
     void setWidthHeight();
+    // expects consumerMutex
     bool grabFrame(double timeOut);
 
+    // Serializes the consumers (the caller's thread and a listener thread): grabbing takes the triple
+    // buffer's front and rewrites the grabbed image that retrieveFrame reads.
+    std::mutex consumerMutex;
+
     int camNum;
     int width;
     int height;
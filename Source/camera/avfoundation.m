@@ -113,7 +113,10 @@ videoInput::~videoInput() { stopCaptureDevice(); }
 
 int videoInput::didStart() { return started; }
 
-bool videoInput::grabFrame() { return grabFrame(1); }
+bool videoInput::grabFrame() {
+    std::lock_guard<std::mutex> lock(consumerMutex);
+    return grabFrame(1);
+}
 
 bool videoInput::grabFrame(double timeOut) {
     NSAutoreleasePool *localpool = [[NSAutoreleasePool alloc] init];
@@ -128,7 +131,24 @@ bool videoInput::grabFrame(double timeOut) {
     return isGrabbed;
 }
 
-void videoInput::retrieveFrame(uint8_t* buffer, bool rgb, bool flipX, bool flipY) { return [mCapture getOutput:buffer forRGB:rgb forFlipX:flipX forFlipY:flipY] ; }
+bool videoInput::waitForFrame(uint64_t lastSequence, int timeoutMs, int64_t& timestampNs, uint64_t& sequence) {
+    if (![mCapture waitForFrame:timeoutMs after:lastSequence]) return false;
+    sequence = [mCapture latestSequence];
+    timestampNs = [mCapture latestTimestampNs];
+    return true;
+}
+
+void videoInput::retrieveFrame(uint8_t* buffer, bool rgb, bool flipX, bool flipY) {
+    std::lock_guard<std::mutex> lock(consumerMutex);
+    [mCapture getOutput:buffer forRGB:rgb forFlipX:flipX forFlipY:flipY];
+}
+
+void videoInput::retrieveLatestFrame(uint8_t* buffer, bool rgb, bool flipX, bool flipY, uint64_t& lastSequence) {
+    std::lock_guard<std::mutex> lock(consumerMutex);
+    grabFrame(1);
+    [mCapture getOutput:buffer forRGB:rgb forFlipX:flipX forFlipY:flipY];
+    lastSequence = [mCapture grabbedSequence];
+}
 
 void videoInput::stopCaptureDevice() {
     NSAutoreleasePool *localpool = [[NSAutoreleasePool alloc] init];
@@ -355,7 +375,10 @@ void videoInput::setWidthHeight() {
     }
     
     // flush old size image
-    grabFrame(1);
+    {
+        std::lock_guard<std::mutex> lock(consumerMutex);
+        grabFrame(1);
+    }
     
     [pixelBufferOptions release];
 }
@@ -457,10 +480,10 @@ bool videoInput::setProperty(PROPERTY property_id, double value) {
 
 - (id)init {
     [super init];
-    std::mutex newFrameMutex;
-    bool mHasNewFrame = false;
-    mCurrentImageBuffer = NULL;
     mGrabbedPixels = NULL;
+    mGrabbedSequence = 0;
+    mLatestSequence = 0;
+    mLatestTimestampNs = 0;
     mDeviceImage = NULL;
     mOutImageData = NULL;
     mOutImageDataFlip = NULL;
@@ -476,7 +499,9 @@ bool videoInput::setProperty(PROPERTY property_id, double value) {
       free(mOutImageDataFlip);
     }
     cvReleaseImage(&mDeviceImage);
-    CVBufferRelease(mCurrentImageBuffer);
+    for (int i = 0; i < 3; i++) {
+        CVBufferRelease(mFrames.slot(i).value);
+    }
     CVBufferRelease(mGrabbedPixels);
     [super dealloc];
 }
@@ -491,10 +516,16 @@ didOutputSampleBuffer:(CMSampleBufferRef)sampleBuffer
     CVImageBufferRef imageBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
     CVBufferRetain(imageBuffer);
     
-    std::lock_guard<std::mutex> lk(newFrameMutex);
-    CVBufferRelease(mCurrentImageBuffer);
-    mCurrentImageBuffer = imageBuffer;
-    mHasNewFrame = true;
+    // the back slot holds a frame the consumer never took, or one it is done with
+    CVBufferRelease(mFrames.back().value);
+    mFrames.back().value = imageBuffer;
+    int64_t timestampNs = TripleBuffer<CVImageBufferRef>::Now();
+    uint64_t sequence = mFrames.publish(timestampNs);
+    mLatestTimestampNs.store(timestampNs, std::memory_order_relaxed);
+    mLatestSequence.store(sequence, std::memory_order_release);
+    // empty critical section: a waiter between its check and its wait cannot miss the notification
+    { std::lock_guard<std::mutex> lock(mWaitMutex); }
+    mFrameArrived.notify_all();
 }
 
 - (void)getOutput:(uint8_t *)buffer forRGB:(bool)rgb forFlipX:(bool)flipX forFlipY:(bool)flipY {
@@ -540,20 +571,42 @@ didOutputSampleBuffer:(CMSampleBufferRef)sampleBuffer
 
 - (BOOL)grabImageUntilDate {
     BOOL isGrabbed = NO;
-    std::lock_guard<std::mutex> lk(newFrameMutex);
     
     if (mGrabbedPixels) {
         CVBufferRelease(mGrabbedPixels);
+        mGrabbedPixels = NULL;
     }
-    if (mHasNewFrame) {
-        mHasNewFrame = false;
+    if (mFrames.update()) {
         isGrabbed = YES;
-        mGrabbedPixels = CVBufferRetain(mCurrentImageBuffer);
+        mGrabbedPixels = CVBufferRetain(mFrames.front().value);
+        mGrabbedSequence = mFrames.front().sequence;
     }
     
     return isGrabbed;
 }
 
+// Compared with != as the sequence of a restarted session starts again.
+- (BOOL)waitForFrame:(int)timeoutMs after:(uint64_t)lastSequence {
+    std::unique_lock<std::mutex> lock(mWaitMutex);
+    bool arrived = mFrameArrived.wait_for(lock, std::chrono::milliseconds(timeoutMs), [self, lastSequence]() {
+        uint64_t sequence = self->mLatestSequence.load(std::memory_order_acquire);
+        return sequence != 0 && sequence != lastSequence;
+    });
+    return arrived ? YES : NO;
+}
+
+- (uint64_t)latestSequence {
+    return mLatestSequence.load(std::memory_order_acquire);
+}
+
+- (int64_t)latestTimestampNs {
+    return mLatestTimestampNs.load(std::memory_order_relaxed);
+}
+
+- (uint64_t)grabbedSequence {
+    return mGrabbedSequence;
+}
+
 - (int)updateImage {
     if (!mGrabbedPixels) {
         return 0;
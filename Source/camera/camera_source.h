@@ -0,0 +1,63 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+// A Linux camera backend (V4L2 device or virtual camera) as seen by VI::Camera. Consumers identify the
+// frames they already got by sequence, so several of them can read one source.
+class CameraSource {
+public:
+    virtual ~CameraSource() {}
+
+    virtual bool start() = 0;
+    virtual void stop() = 0;
+    virtual bool didStart() const = 0;
+
+    virtual int getWidth() const = 0;
+    virtual int getHeight() const = 0;
+
+    // A frame other than lastSequence has been published.
+    virtual bool isFrameNew(uint64_t lastSequence) const = 0;
+    // Blocks until a frame other than lastSequence is published, false on timeout.
+    // timestampNs receives its capture time (steady clock), sequence the frame's sequence.
+    virtual bool waitForFrame(uint64_t lastSequence, int timeoutMs, int64_t& timestampNs, uint64_t& sequence) = 0;
+    // Waits up to a second for a frame other than lastSequence, converts it into dst (packed BGR24 or RGB24)
+    // and updates lastSequence.
+    virtual bool getPixels(unsigned char* dst, bool rgb, bool flipX, bool flipY, uint64_t& lastSequence) = 0;
+};
+
+// Wakes the consumers of a capture thread. The capture thread only takes the mutex for an empty critical
+// section, so a waiter between its check and its wait cannot miss the notification.
+class FrameSignal {
+public:
+    void notify(uint64_t sequence, int64_t timestampNs) {
+        // the timestamp is written first and read after the sequence, a waiter may get the timestamp of a
+        // newer frame than the sequence it woke for, never an older one
+        m_timestampNs.store(timestampNs, std::memory_order_relaxed);
+        m_sequence.store(sequence, std::memory_order_release);
+        { std::lock_guard<std::mutex> lock(m_mutex); }
+        m_arrived.notify_all();
+    }
+
+    // Compared with != as a restarted source starts counting again.
+    bool isNew(uint64_t lastSequence) const {
+        uint64_t sequence = m_sequence.load(std::memory_order_acquire);
+        return sequence != 0 && sequence != lastSequence;
+    }
+
+    bool wait(uint64_t lastSequence, int timeoutMs, int64_t& timestampNs, uint64_t& sequence) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_arrived.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&]() { return isNew(lastSequence); })) return false;
+        sequence = m_sequence.load(std::memory_order_acquire);
+        timestampNs = m_timestampNs.load(std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    std::atomic<uint64_t> m_sequence{0};
+    std::atomic<int64_t> m_timestampNs{0};
+    std::mutex m_mutex;
+    std::condition_variable m_arrived;
+};
@@ -0,0 +1,274 @@
+#include "pixel_kernels.h"
+#include <stddef.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+// The x86 kernels are built whatever the target flags say and picked by CPUID at first use, so a
+// default build still gets them. GCC and Clang need the ISA on every function using its intrinsics.
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#define PIXELS_X86 1
+#if defined(__GNUC__) || defined(__clang__)
+#define PIXELS_TARGET(isa) __attribute__((target(isa)))
+#else
+#define PIXELS_TARGET(isa)
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PIXELS_NEON 1
+#endif
+
+namespace Pixels {
+
+// Pixels [x, width) of one row, the vector kernels leave their tail to it.
+template <int CN, bool SWAP, bool MIRROR>
+static inline void RowScalar(const uint8_t* src, uint8_t* dst, int x, int width) {
+    for (; x < width; x++) {
+        const uint8_t* s = src + (MIRROR ? width - 1 - x : x) * CN;
+        uint8_t* d = dst + x * CN;
+        d[0] = s[SWAP ? 2 : 0];
+        d[1] = s[1];
+        d[2] = s[SWAP ? 0 : 2];
+        if (CN == 4) d[3] = s[3];
+    }
+}
+
+// Every instruction set provides Row3 / Row4, which convert the leading pixels of a row and return how
+// many they did. With TEE every store goes to copy as well.
+struct Scalar {
+    template <bool SWAP, bool MIRROR, bool TEE>
+    static int Row3(const uint8_t*, uint8_t*, uint8_t*, int) {
+        return 0;
+    }
+    template <bool SWAP, bool MIRROR, bool TEE>
+    static int Row4(const uint8_t*, uint8_t*, uint8_t*, int) {
+        return 0;
+    }
+};
+
+#if defined(PIXELS_X86)
+struct Ssse3 {
+    // 5 pixels per 16 bytes. Byte 15 of every store is garbage that the next store (or the scalar tail)
+    // overwrites, so the loop stops one pixel early to never write past the row.
+    template <bool SWAP, bool MIRROR, bool TEE>
+    PIXELS_TARGET("ssse3") static int Row3(const uint8_t* src, uint8_t* dst, uint8_t* copy, int width) {
+        int8_t mask[16];
+        for (int j = 0; j < 5; j++) {
+            for (int c = 0; c < 3; c++) {
+                int sc = SWAP ? 2 - c : c;
+                // mirrored loads start one byte early so that they never read past the row either
+                mask[j * 3 + c] = (int8_t)(MIRROR ? 1 + (4 - j) * 3 + sc : j * 3 + sc);
+            }
+        }
+        mask[15] = (int8_t)0x80;
+        __m128i shuffle = _mm_loadu_si128((const __m128i*)mask);
+        int x = 0;
+        for (; x + 6 <= width; x += 5) {
+            const uint8_t* s = MIRROR ? src + (width - 5 - x) * 3 - 1 : src + x * 3;
+            __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)s), shuffle);
+            _mm_storeu_si128((__m128i*)(dst + x * 3), v);
+            if (TEE) _mm_storeu_si128((__m128i*)(copy + x * 3), v);
+        }
+        return x;
+    }
+
+    template <bool SWAP, bool MIRROR, bool TEE>
+    PIXELS_TARGET("ssse3") static int Row4(const uint8_t* src, uint8_t* dst, uint8_t* copy, int width) {
+        return Row4From<SWAP, MIRROR, TEE>(src, dst, copy, 0, width);
+    }
+
+    template <bool SWAP, bool MIRROR, bool TEE>
+    PIXELS_TARGET("ssse3") static int Row4From(const uint8_t* src, uint8_t* dst, uint8_t* copy, int x, int width) {
+        int8_t mask[16];
+        for (int j = 0; j < 4; j++) {
+            int sj = MIRROR ? 3 - j : j;
+            for (int c = 0; c < 4; c++) mask[j * 4 + c] = (int8_t)(sj * 4 + (c < 3 && SWAP ? 2 - c : c));
+        }
+        __m128i shuffle = _mm_loadu_si128((const __m128i*)mask);
+        for (; x + 4 <= width; x += 4) {
+            const uint8_t* s = MIRROR ? src + (width - 4 - x) * 4 : src + x * 4;
+            __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)s), shuffle);
+            _mm_storeu_si128((__m128i*)(dst + x * 4), v);
+            if (TEE) _mm_storeu_si128((__m128i*)(copy + x * 4), v);
+        }
+        return x;
+    }
+};
+
+struct Avx2 {
+    // 24-bit pixels do not split evenly into 128-bit lanes, they keep the SSSE3 kernel.
+    template <bool SWAP, bool MIRROR, bool TEE>
+    PIXELS_TARGET("avx2") static int Row3(const uint8_t* src, uint8_t* dst, uint8_t* copy, int width) {
+        return Ssse3::Row3<SWAP, MIRROR, TEE>(src, dst, copy, width);
+    }
+
+    template <bool SWAP, bool MIRROR, bool TEE>
+    PIXELS_TARGET("avx2") static int Row4(const uint8_t* src, uint8_t* dst, uint8_t* copy, int width) {
+        int8_t mask[32];
+        for (int j = 0; j < 8; j++) {
+            // in-lane shuffle first, the lane swap of a mirror comes after it
+            int sj = MIRROR ? 3 - j % 4 : j % 4;
+            for (int c = 0; c < 4; c++) mask[j * 4 + c] = (int8_t)(sj * 4 + (c < 3 && SWAP ? 2 - c : c));
+        }
+        __m256i shuffle = _mm256_loadu_si256((const __m256i*)mask);
+        int x = 0;
+        for (; x + 8 <= width; x += 8) {
+            const uint8_t* s = MIRROR ? src + (width - 8 - x) * 4 : src + x * 4;
+            __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)s), shuffle);
+            if (MIRROR) v = _mm256_permute4x64_epi64(v, 0x4E);
+            _mm256_storeu_si256((__m256i*)(dst + x * 4), v);
+            if (TEE) _mm256_storeu_si256((__m256i*)(copy + x * 4), v);
+        }
+        return Ssse3::Row4From<SWAP, MIRROR, TEE>(src, dst, copy, x, width);
+    }
+};
+#elif defined(PIXELS_NEON)
+static inline uint8x16_t Reverse(uint8x16_t v) {
+    v = vrev64q_u8(v);
+    return vextq_u8(v, v, 8);
+}
+
+struct Neon {
+    // 16 pixels per iteration, the structured loads split the channels into separate registers.
+    template <bool SWAP, bool MIRROR, bool TEE>
+    static int Row3(const uint8_t* src, uint8_t* dst, uint8_t* copy, int width) {
+        int x = 0;
+        for (; x + 16 <= width; x += 16) {
+            uint8x16x3_t v = vld3q_u8(MIRROR ? src + (width - 16 - x) * 3 : src + x * 3);
+            uint8x16x3_t o;
+            o.val[0] = v.val[SWAP ? 2 : 0];
+            o.val[1] = v.val[1];
+            o.val[2] = v.val[SWAP ? 0 : 2];
+            if (MIRROR) {
+                for (int c = 0; c < 3; c++) o.val[c] = Reverse(o.val[c]);
+            }
+            vst3q_u8(dst + x * 3, o);
+            if (TEE) vst3q_u8(copy + x * 3, o);
+        }
+        return x;
+    }
+
+    template <bool SWAP, bool MIRROR, bool TEE>
+    static int Row4(const uint8_t* src, uint8_t* dst, uint8_t* copy, int width) {
+        int x = 0;
+        for (; x + 16 <= width; x += 16) {
+            uint8x16x4_t v = vld4q_u8(MIRROR ? src + (width - 16 - x) * 4 : src + x * 4);
+            uint8x16x4_t o;
+            o.val[0] = v.val[SWAP ? 2 : 0];
+            o.val[1] = v.val[1];
+            o.val[2] = v.val[SWAP ? 0 : 2];
+            o.val[3] = v.val[3];
+            if (MIRROR) {
+                for (int c = 0; c < 4; c++) o.val[c] = Reverse(o.val[c]);
+            }
+            vst4q_u8(dst + x * 4, o);
+            if (TEE) vst4q_u8(copy + x * 4, o);
+        }
+        return x;
+    }
+};
+#endif
+
+template <class ISA, int CN, bool SWAP, bool MIRROR, bool TEE>
+static void Row(const uint8_t* src, uint8_t* dst, uint8_t* copy, int width) {
+    if (!SWAP && !MIRROR) {
+        memcpy(dst, src, (size_t)width * CN);
+        if (TEE) memcpy(copy, src, (size_t)width * CN);
+        return;
+    }
+    int x = CN == 3 ? ISA::template Row3<SWAP, MIRROR, TEE>(src, dst, copy, width) : ISA::template Row4<SWAP, MIRROR, TEE>(src, dst, copy, width);
+    RowScalar<CN, SWAP, MIRROR>(src, dst, x, width);
+    // the tail is a few pixels still in L1
+    if (TEE) memcpy(copy + x * CN, dst + x * CN, (size_t)(width - x) * CN);
+}
+
+template <int CN, bool SWAP, bool MIRROR>
+static void RowReference(const uint8_t* src, uint8_t* dst, uint8_t*, int width) {
+    RowScalar<CN, SWAP, MIRROR>(src, dst, 0, width);
+}
+
+typedef void (*RowFunction)(const uint8_t*, uint8_t*, uint8_t*, int);
+typedef RowFunction RowTable[2][2][2];
+
+// One specialization per channel count and flag combination, the row loop itself has no branches.
+static void Convert(const RowTable& rows, const uint8_t* src, int srcStride, uint8_t* dst, uint8_t* copy, int dstStride, int width, int height, int channels, bool swapRB, bool flipX, bool flipY) {
+    if (!src || !dst || width <= 0 || height <= 0 || (channels != 3 && channels != 4)) return;
+    RowFunction row = rows[channels == 4][swapRB][flipX];
+    for (int y = 0; y < height; y++) {
+        const uint8_t* s = src + (ptrdiff_t)(flipY ? height - 1 - y : y) * srcStride;
+        row(s, dst + (ptrdiff_t)y * dstStride, copy ? copy + (ptrdiff_t)y * dstStride : NULL, width);
+    }
+}
+
+// Every channel count and flag combination of one instruction set, without and with the copy.
+#define PIXELS_ROW_TABLE(ISA, TEE) \
+    {{{Row<ISA, 3, false, false, TEE>, Row<ISA, 3, false, true, TEE>}, {Row<ISA, 3, true, false, TEE>, Row<ISA, 3, true, true, TEE>}}, \
+     {{Row<ISA, 4, false, false, TEE>, Row<ISA, 4, false, true, TEE>}, {Row<ISA, 4, true, false, TEE>, Row<ISA, 4, true, true, TEE>}}}
+#define PIXELS_ROWS(ISA) \
+    { PIXELS_ROW_TABLE(ISA, false), PIXELS_ROW_TABLE(ISA, true) }
+
+struct Kernels {
+    const char* isa;
+    RowTable rows[2];  // [with copy]
+};
+
+// The best instruction set this CPU (and, for AVX2, the OS) supports.
+static const Kernels& SelectKernels() {
+#if defined(PIXELS_X86)
+    static const Kernels avx2 = {"avx2", PIXELS_ROWS(Avx2)};
+    static const Kernels ssse3 = {"ssse3", PIXELS_ROWS(Ssse3)};
+    static const Kernels scalar = {"scalar", PIXELS_ROWS(Scalar)};
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool hasSsse3 = (info[2] & (1 << 9)) != 0;
+    // AVX2 also needs the OS to save the YMM registers, which OSXSAVE + XCR0 tell
+    bool hasAvx2 = false;
+    if (maxLeaf >= 7 && (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(info, 7, 0);
+        hasAvx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool hasSsse3 = __builtin_cpu_supports("ssse3");
+    bool hasAvx2 = __builtin_cpu_supports("avx2");
+#endif
+    return hasAvx2 ? avx2 : hasSsse3 ? ssse3 : scalar;
+#elif defined(PIXELS_NEON)
+    static const Kernels neon = {"neon", PIXELS_ROWS(Neon)};
+    return neon;
+#else
+    static const Kernels scalar = {"scalar", PIXELS_ROWS(Scalar)};
+    return scalar;
+#endif
+}
+
+static const Kernels& CurrentKernels() {
+    static const Kernels& kernels = SelectKernels();
+    return kernels;
+}
+
+const char* KernelIsa() {
+    return CurrentKernels().isa;
+}
+
+void ConvertPacked(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride, int width, int height, int channels, bool swapRB, bool flipX, bool flipY) {
+    Convert(CurrentKernels().rows[0], src, srcStride, dst, NULL, dstStride, width, height, channels, swapRB, flipX, flipY);
+}
+
+void ConvertPackedTee(const uint8_t* src, int srcStride, uint8_t* dst, uint8_t* copy, int dstStride, int width, int height, int channels, bool swapRB, bool flipX, bool flipY) {
+    Convert(CurrentKernels().rows[copy != NULL], src, srcStride, dst, copy, dstStride, width, height, channels, swapRB, flipX, flipY);
+}
+
+void ConvertPackedScalar(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride, int width, int height, int channels, bool swapRB, bool flipX, bool flipY) {
+    static const RowFunction rows[2][2][2] = {
+        {{RowReference<3, false, false>, RowReference<3, false, true>}, {RowReference<3, true, false>, RowReference<3, true, true>}},
+        {{RowReference<4, false, false>, RowReference<4, false, true>}, {RowReference<4, true, false>, RowReference<4, true, true>}},
+    };
+    Convert(rows, src, srcStride, dst, NULL, dstStride, width, height, channels, swapRB, flipX, flipY);
+}
+
+}  // namespace Pixels
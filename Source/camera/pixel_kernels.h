@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+
+namespace Pixels {
+
+// Which vector unit the kernels run on: "avx2", "ssse3", "neon" or "scalar". x86 picks it from the CPU at
+// first use, whatever the compiler flags.
+const char* KernelIsa();
+
+// Copies a packed image with 3 (BGR / RGB) or 4 (BGRA / RGBA) bytes per pixel, optionally swapping the
+// red and blue channels, mirroring every row (flipX) and reversing the row order (flipY). Rows are
+// srcStride / dstStride bytes apart, src and dst must not overlap.
+void ConvertPacked(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride, int width, int height, int channels, bool swapRB, bool flipX, bool flipY);
+
+// ConvertPacked writing the image to both dst and copy (rows dstStride bytes apart in each) in the same
+// pass, for a conversion that is handed out and kept at once. With a NULL copy it is ConvertPacked.
+void ConvertPackedTee(const uint8_t* src, int srcStride, uint8_t* dst, uint8_t* copy, int dstStride, int width, int height, int channels, bool swapRB, bool flipX, bool flipY);
+
+// The plain per-pixel version of ConvertPacked, the reference the vector kernels are checked against.
+void ConvertPackedScalar(const uint8_t* src, int srcStride, uint8_t* dst, int dstStride, int width, int height, int channels, bool swapRB, bool flipX, bool flipY);
+
+}  // namespace Pixels
@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+// Lock-free handoff of the latest frame from one producer (the capture callback) to one consumer.
+// Three slots rotate between the producer (back), the handoff point (middle) and the consumer (front):
+// the producer never waits, and the consumer always picks up the most recent complete frame while older
+// unconsumed frames are overwritten. Concurrent consumers must be serialized by the caller.
+template <typename T>
+class TripleBuffer {
+public:
+    struct Slot {
+        T value{};
+        uint64_t sequence = 0;
+        int64_t timestampNs = 0;
+    };
+
+    static int64_t Now() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+    // Producer side: fill back(), then publish it. Returns the sequence of the published frame, starting at 1.
+    Slot& back() { return m_slots[m_back]; }
+    uint64_t publish(int64_t timestampNs = Now()) {
+        Slot& slot = m_slots[m_back];
+        uint64_t sequence = slot.sequence = ++m_published;
+        slot.timestampNs = timestampNs;
+        m_back = m_middle.exchange(m_back | NewFlag, std::memory_order_acq_rel) & IndexMask;
+        return sequence;
+    }
+
+    // Consumer side: takes the latest published frame as front(), returns false if there was none since the last call.
+    bool update() {
+        if (!(m_middle.load(std::memory_order_relaxed) & NewFlag)) return false;
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+    bool hasNew() const { return (m_middle.load(std::memory_order_acquire) & NewFlag) != 0; }
+    Slot& front() { return m_slots[m_front]; }
+
+    // Every slot, for setup and teardown while neither side is running.
+    Slot& slot(int index) { return m_slots[index]; }
+
+private:
+    static const uint8_t IndexMask = 3;
+    static const uint8_t NewFlag = 4;
+
+    Slot m_slots[3];
+    // middle index, plus NewFlag while it holds a frame the consumer has not taken yet
+    std::atomic<uint8_t> m_middle{1};
+    uint8_t m_back = 0;   // producer only
+    uint8_t m_front = 2;  // consumer only
+    uint64_t m_published = 0;
+};
@@ -0,0 +1,397 @@
+#ifdef __linux__
+#include "v4l2_camera.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include "pixel_kernels.h"
+#include "utils.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+// Driver buffers, two of them can be out of the driver's queue (the published and the consumer's frame).
+static const unsigned int BufferCount = 6;
+
+// In order of preference: uncompressed formats only cost a colour conversion.
+static const uint32_t SupportedFormats[] = {V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_MJPEG};
+
+static int xioctl(int fd, unsigned long request, void* arg) {
+    int result;
+    do {
+        result = ioctl(fd, request, arg);
+    } while (result == -1 && errno == EINTR);
+    return result;
+}
+
+static int FormatRank(uint32_t fourcc) {
+    for (int i = 0; i < (int)(sizeof(SupportedFormats) / sizeof(SupportedFormats[0])); i++) {
+        if (SupportedFormats[i] == fourcc) return i;
+    }
+    return -1;
+}
+
+// Highest frame rate of a format and size, 0 when the driver does not enumerate intervals.
+static double MaxFrameRate(int fd, uint32_t fourcc, int width, int height) {
+    double best = 0;
+    v4l2_frmivalenum interval;
+    memset(&interval, 0, sizeof(interval));
+    interval.pixel_format = fourcc;
+    interval.width = width;
+    interval.height = height;
+    for (interval.index = 0; xioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &interval) == 0; interval.index++) {
+        const v4l2_fract& fraction = interval.type == V4L2_FRMIVAL_TYPE_DISCRETE ? interval.discrete : interval.stepwise.min;
+        if (fraction.numerator) best = std::max(best, (double)fraction.denominator / fraction.numerator);
+        if (interval.type != V4L2_FRMIVAL_TYPE_DISCRETE) break;
+    }
+    return best;
+}
+
+std::vector<V4L2Camera::DeviceInfo> V4L2Camera::ListDevices() {
+    std::vector<DeviceInfo> devices;
+    for (int i = 0; i < 64; i++) {
+        std::string path = "/dev/video" + std::to_string(i);
+        int fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) continue;
+        v4l2_capability capability;
+        memset(&capability, 0, sizeof(capability));
+        if (xioctl(fd, VIDIOC_QUERYCAP, &capability) == 0) {
+            // UVC cameras also expose a metadata node, which has no video capture capability
+            uint32_t caps = (capability.capabilities & V4L2_CAP_DEVICE_CAPS) ? capability.device_caps : capability.capabilities;
+            if ((caps & V4L2_CAP_VIDEO_CAPTURE) && (caps & V4L2_CAP_STREAMING)) {
+                DeviceInfo device;
+                device.path = path;
+                device.name = std::string((const char*)capability.card, strnlen((const char*)capability.card, sizeof(capability.card)));
+                devices.push_back(device);
+            }
+        }
+        close(fd);
+    }
+    return devices;
+}
+
+V4L2Camera::V4L2Camera(const std::string& path, int width, int height, int fps) : m_path(path), m_requestedWidth(width), m_requestedHeight(height), m_requestedFps(fps) {}
+
+V4L2Camera::~V4L2Camera() {
+    stop();
+    avcodec_free_context(&m_decoder);
+    av_frame_free(&m_decoded);
+    av_packet_free(&m_packet);
+    sws_freeContext(m_sws);
+}
+
+bool V4L2Camera::negotiate() {
+    v4l2_format current;
+    memset(&current, 0, sizeof(current));
+    current.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(m_fd, VIDIOC_G_FMT, &current) < 0) return false;
+    int targetWidth = m_requestedWidth > 0 ? m_requestedWidth : (int)current.fmt.pix.width;
+    int targetHeight = m_requestedHeight > 0 ? m_requestedHeight : (int)current.fmt.pix.height;
+
+    // closest size first, then a frame rate reaching the requested one, then the cheaper format
+    uint32_t bestFormat = 0;
+    int bestWidth = targetWidth, bestHeight = targetHeight;
+    long bestCost = LONG_MAX;
+    bool bestFast = false;
+    int bestRank = INT_MAX;
+    auto consider = [&](uint32_t fourcc, int width, int height) {
+        long cost = labs((long)width - targetWidth) + labs((long)height - targetHeight);
+        double fps = MaxFrameRate(m_fd, fourcc, width, height);
+        bool fast = m_requestedFps <= 0 || fps == 0 || fps + 0.5 >= m_requestedFps;
+        int rank = FormatRank(fourcc);
+        if (cost < bestCost || (cost == bestCost && (fast > bestFast || (fast == bestFast && rank < bestRank)))) {
+            bestFormat = fourcc;
+            bestWidth = width;
+            bestHeight = height;
+            bestCost = cost;
+            bestFast = fast;
+            bestRank = rank;
+        }
+    };
+
+    v4l2_fmtdesc description;
+    memset(&description, 0, sizeof(description));
+    description.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    for (description.index = 0; xioctl(m_fd, VIDIOC_ENUM_FMT, &description) == 0; description.index++) {
+        uint32_t fourcc = description.pixelformat;
+        if (FormatRank(fourcc) < 0) continue;
+        v4l2_frmsizeenum size;
+        memset(&size, 0, sizeof(size));
+        size.pixel_format = fourcc;
+        bool enumerated = false;
+        for (size.index = 0; xioctl(m_fd, VIDIOC_ENUM_FRAMESIZES, &size) == 0; size.index++) {
+            enumerated = true;
+            if (size.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+                consider(fourcc, size.discrete.width, size.discrete.height);
+            } else {
+                const v4l2_frmsize_stepwise& range = size.stepwise;
+                int stepX = std::max<int>(range.step_width, 1), stepY = std::max<int>(range.step_height, 1);
+                int width = std::min<int>(std::max<int>(targetWidth, range.min_width), range.max_width);
+                int height = std::min<int>(std::max<int>(targetHeight, range.min_height), range.max_height);
+                consider(fourcc, range.min_width + (width - range.min_width) / stepX * stepX, range.min_height + (height - range.min_height) / stepY * stepY);
+                break;
+            }
+        }
+        // no size enumeration, the driver adjusts whatever S_FMT asks for
+        if (!enumerated) consider(fourcc, targetWidth, targetHeight);
+    }
+    if (!bestFormat) {
+        Utils::LoggerPrintf(VI::LogLevel::Error, "V4L2: %s offers none of YUYV, NV12 or MJPEG\n", m_path.c_str());
+        return false;
+    }
+
+    v4l2_format format;
+    memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    format.fmt.pix.width = bestWidth;
+    format.fmt.pix.height = bestHeight;
+    format.fmt.pix.pixelformat = bestFormat;
+    format.fmt.pix.field = V4L2_FIELD_ANY;
+    if (xioctl(m_fd, VIDIOC_S_FMT, &format) < 0 || FormatRank(format.fmt.pix.pixelformat) < 0) {
+        Utils::LoggerPrintf(VI::LogLevel::Error, "V4L2: %s refused format %dx%d: %s\n", m_path.c_str(), bestWidth, bestHeight, strerror(errno));
+        return false;
+    }
+    m_width = format.fmt.pix.width;
+    m_height = format.fmt.pix.height;
+    m_pixelFormat = format.fmt.pix.pixelformat;
+    m_bytesPerLine = format.fmt.pix.bytesperline;
+    if (!m_bytesPerLine && m_pixelFormat != V4L2_PIX_FMT_MJPEG) m_bytesPerLine = m_pixelFormat == V4L2_PIX_FMT_YUYV ? m_width * 2 : m_width;
+    // what the conversion reads from an uncompressed frame, a shorter one would be converted from stale data
+    m_frameBytes = m_pixelFormat == V4L2_PIX_FMT_MJPEG ? 0 : m_pixelFormat == V4L2_PIX_FMT_NV12 ? (size_t)m_bytesPerLine * m_height * 3 / 2 : (size_t)m_bytesPerLine * m_height;
+
+    if (m_requestedFps > 0) {
+        v4l2_streamparm parm;
+        memset(&parm, 0, sizeof(parm));
+        parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        if (xioctl(m_fd, VIDIOC_G_PARM, &parm) == 0 && (parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME)) {
+            parm.parm.capture.timeperframe.numerator = 1;
+            parm.parm.capture.timeperframe.denominator = m_requestedFps;
+            // the driver writes back the interval it picked, which may be the closest one it supports
+            const v4l2_fract& granted = parm.parm.capture.timeperframe;
+            if (xioctl(m_fd, VIDIOC_S_PARM, &parm) < 0) {
+                Utils::LoggerPrintf(VI::LogLevel::Warning, "V4L2: %s refused %d fps: %s\n", m_path.c_str(), m_requestedFps, strerror(errno));
+            } else if (granted.numerator && fabs((double)granted.denominator / granted.numerator - m_requestedFps) > 0.5) {
+                Utils::LoggerPrintf(VI::LogLevel::Warning, "V4L2: %s streams at %.2f fps instead of %d\n", m_path.c_str(), (double)granted.denominator / granted.numerator, m_requestedFps);
+            }
+        }
+    }
+    CV_LOG_DEBUG(NULL, "V4L2: " << m_path << " streams " << m_width << "x" << m_height << " " << std::string((const char*)&m_pixelFormat, 4));
+    return true;
+}
+
+bool V4L2Camera::mapBuffers() {
+    v4l2_requestbuffers request;
+    memset(&request, 0, sizeof(request));
+    request.count = BufferCount;
+    request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_MMAP;
+    // the triple buffer keeps up to two of them, the driver needs at least one to fill
+    if (xioctl(m_fd, VIDIOC_REQBUFS, &request) < 0 || request.count < 3) {
+        Utils::LoggerPrintf(VI::LogLevel::Error, "V4L2: %s has no mmap streaming buffers\n", m_path.c_str());
+        return false;
+    }
+    m_buffers.resize(request.count);
+    for (unsigned int i = 0; i < request.count; i++) {
+        v4l2_buffer buffer;
+        memset(&buffer, 0, sizeof(buffer));
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.index = i;
+        if (xioctl(m_fd, VIDIOC_QUERYBUF, &buffer) < 0) return false;
+        if (buffer.length < m_frameBytes) {
+            Utils::LoggerPrintf(VI::LogLevel::Error, "V4L2: %s buffers hold %u bytes, a frame needs %zu\n", m_path.c_str(), buffer.length, m_frameBytes);
+            return false;
+        }
+        void* start = mmap(NULL, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, buffer.m.offset);
+        if (start == MAP_FAILED) return false;
+        m_buffers[i].start = start;
+        m_buffers[i].length = buffer.length;
+        if (!queue(i)) return false;
+    }
+    return true;
+}
+
+void V4L2Camera::unmapBuffers() {
+    for (Buffer& buffer : m_buffers) {
+        if (buffer.start) munmap(buffer.start, buffer.length);
+    }
+    m_buffers.clear();
+    v4l2_requestbuffers request;
+    memset(&request, 0, sizeof(request));
+    request.count = 0;
+    request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_MMAP;
+    xioctl(m_fd, VIDIOC_REQBUFS, &request);
+}
+
+bool V4L2Camera::queue(int index) {
+    v4l2_buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = index;
+    return xioctl(m_fd, VIDIOC_QBUF, &buffer) == 0;
+}
+
+// From the poll thread: a buffer the driver does not get back is gone until the next start(), and with all
+// of them gone the stream stalls, so that is worth an error.
+void V4L2Camera::requeue(int index) {
+    if (!queue(index)) Utils::LoggerPrintf(VI::LogLevel::Error, "V4L2: %s did not take buffer %d back: %s\n", m_path.c_str(), index, strerror(errno));
+}
+
+bool V4L2Camera::start() {
+    if (m_started) return true;
+    m_fd = open(m_path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (m_fd < 0) {
+        Utils::LoggerPrintf(VI::LogLevel::Error, "V4L2: unable to open %s: %s\n", m_path.c_str(), strerror(errno));
+        return false;
+    }
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (!negotiate() || !mapBuffers() || xioctl(m_fd, VIDIOC_STREAMON, &type) < 0) {
+        unmapBuffers();
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    for (int i = 0; i < 3; i++) m_frames.slot(i).value = Frame();
+    m_stop = false;
+    m_thread = std::thread(&V4L2Camera::run, this);
+    m_started = true;
+    return true;
+}
+
+void V4L2Camera::stop() {
+    if (!m_started) return;
+    m_stop = true;
+    m_thread.join();
+    // a consumer may still be converting out of a mapped buffer
+    std::lock_guard<std::mutex> lock(m_consumerMutex);
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    xioctl(m_fd, VIDIOC_STREAMOFF, &type);
+    unmapBuffers();
+    close(m_fd);
+    m_fd = -1;
+    for (int i = 0; i < 3; i++) m_frames.slot(i).value = Frame();
+    m_started = false;
+}
+
+void V4L2Camera::run() {
+    while (!m_stop.load(std::memory_order_relaxed)) {
+        pollfd descriptor = {m_fd, POLLIN, 0};
+        // a short timeout, so that stop() never waits for a silent device
+        int ready = poll(&descriptor, 1, 100);
+        if (ready < 0 && errno != EINTR) {
+            Utils::LoggerPrintf(VI::LogLevel::Error, "V4L2: poll on %s failed: %s\n", m_path.c_str(), strerror(errno));
+            break;
+        }
+        if (ready <= 0) continue;
+
+        v4l2_buffer buffer;
+        memset(&buffer, 0, sizeof(buffer));
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        if (xioctl(m_fd, VIDIOC_DQBUF, &buffer) < 0) {
+            if (errno == EAGAIN) continue;
+            // ENODEV once the camera is unplugged
+            Utils::LoggerPrintf(VI::LogLevel::Error, "V4L2: %s stopped streaming: %s\n", m_path.c_str(), strerror(errno));
+            break;
+        }
+        if ((buffer.flags & V4L2_BUF_FLAG_ERROR) || buffer.bytesused == 0 || buffer.bytesused < m_frameBytes || buffer.index >= m_buffers.size()) {
+            if (buffer.index < m_buffers.size()) requeue(buffer.index);
+            continue;
+        }
+
+        // driver timestamps are CLOCK_MONOTONIC, the steady clock of the handoff
+        int64_t timestampNs = (buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC ? (int64_t)buffer.timestamp.tv_sec * 1000000000 + (int64_t)buffer.timestamp.tv_usec * 1000 : TripleBuffer<Frame>::Now();
+        Frame& back = m_frames.back().value;
+        back.index = buffer.index;
+        back.bytesUsed = buffer.bytesused;
+        uint64_t sequence = m_frames.publish(timestampNs);
+        // the slot coming back holds a frame nobody took, or one a consumer is done with
+        Frame& released = m_frames.back().value;
+        if (released.index >= 0) {
+            requeue(released.index);
+            released.index = -1;
+        }
+        m_signal.notify(sequence, timestampNs);
+    }
+}
+
+bool V4L2Camera::getPixels(unsigned char* dst, bool rgb, bool flipX, bool flipY, uint64_t& lastSequence) {
+    int64_t timestampNs;
+    uint64_t sequence;
+    if (!m_started || !m_signal.wait(lastSequence, 1000, timestampNs, sequence)) return false;
+
+    std::lock_guard<std::mutex> lock(m_consumerMutex);
+    if (!m_started) return false;
+    m_frames.update();
+    auto& frame = m_frames.front();
+    if (frame.value.index < 0 || !convert(frame.value, dst, rgb, flipX, flipY)) return false;
+    lastSequence = frame.sequence;
+    return true;
+}
+
+bool V4L2Camera::convert(const Frame& frame, unsigned char* dst, bool rgb, bool flipX, bool flipY) {
+    uint8_t* data = (uint8_t*)m_buffers[frame.index].start;
+    const uint8_t* planes[4] = {};
+    int strides[4] = {};
+    AVPixelFormat format;
+    if (m_pixelFormat == V4L2_PIX_FMT_MJPEG) {
+        if (!m_decoder) {
+            const AVCodec* codec = avcodec_find_decoder(AV_CODEC_ID_MJPEG);
+            m_decoder = codec ? avcodec_alloc_context3(codec) : nullptr;
+            if (!m_decoder || avcodec_open2(m_decoder, codec, nullptr) < 0) {
+                Utils::LoggerPrintf(VI::LogLevel::Error, "V4L2: no MJPEG decoder\n");
+                avcodec_free_context(&m_decoder);
+                return false;
+            }
+            m_decoded = av_frame_alloc();
+            m_packet = av_packet_alloc();
+        }
+        // not reference counted, so the decoder copies the payload out of the driver buffer
+        m_packet->data = data;
+        m_packet->size = (int)frame.bytesUsed;
+        if (avcodec_send_packet(m_decoder, m_packet) < 0 || avcodec_receive_frame(m_decoder, m_decoded) < 0) {
+            CV_LOG_DEBUG(NULL, "V4L2: dropping a corrupt MJPEG frame from " << m_path);
+            return false;
+        }
+        if (m_decoded->width != m_width || m_decoded->height != m_height) return false;
+        for (int i = 0; i < 4; i++) {
+            planes[i] = m_decoded->data[i];
+            strides[i] = m_decoded->linesize[i];
+        }
+        format = (AVPixelFormat)m_decoded->format;
+    } else if (m_pixelFormat == V4L2_PIX_FMT_YUYV) {
+        planes[0] = data;
+        strides[0] = m_bytesPerLine;
+        format = AV_PIX_FMT_YUYV422;
+    } else {
+        planes[0] = data;
+        strides[0] = m_bytesPerLine;
+        planes[1] = data + (size_t)m_bytesPerLine * m_height;
+        strides[1] = m_bytesPerLine;
+        format = AV_PIX_FMT_NV12;
+    }
+
+    // straight into dst unless a flip is wanted, which the pixel kernels do in a second pass
+    bool direct = !flipX && !flipY;
+    int stride = m_width * 3;
+    if (!direct) m_converted.resize((size_t)stride * m_height);
+    m_sws = sws_getCachedContext(m_sws, m_width, m_height, format, m_width, m_height, rgb ? AV_PIX_FMT_RGB24 : AV_PIX_FMT_BGR24, SWS_BICUBIC, NULL, NULL, NULL);
+    if (!m_sws) return false;
+    uint8_t* outPlanes[4] = {direct ? dst : m_converted.data()};
+    int outStrides[4] = {stride};
+    sws_scale(m_sws, planes, strides, 0, m_height, outPlanes, outStrides);
+    if (!direct) Pixels::ConvertPacked(m_converted.data(), stride, dst, stride, m_width, m_height, 3, false, flipX, flipY);
+    return true;
+}
+#endif
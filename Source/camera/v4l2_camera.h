@@ -0,0 +1,97 @@
+#pragma once
+#ifdef __linux__
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "camera_source.h"
+#include "triple_buffer.h"
+
+struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
+struct SwsContext;
+
+// A Video4Linux2 capture device streaming into driver buffers mapped with mmap. A poll thread dequeues
+// every filled buffer and hands its index over through the triple buffer, so frames are never copied on
+// the way from the kernel: consumers convert straight out of the mapped memory, and a buffer goes back to
+// the driver once a newer frame replaced it. YUYV and NV12 are converted by swscale, MJPEG is decoded
+// by libavcodec on the consumer side, only for the frames that are actually read.
+class V4L2Camera : public CameraSource {
+public:
+    struct DeviceInfo {
+        std::string path;  // /dev/videoN
+        std::string name;  // the driver's card name
+    };
+    // Capture devices that can stream, in /dev/videoN order.
+    static std::vector<DeviceInfo> ListDevices();
+
+    // 0 keeps the device's current size / frame rate.
+    V4L2Camera(const std::string& path, int width = 0, int height = 0, int fps = 0);
+    ~V4L2Camera();
+
+    bool start() override;
+    void stop() override;
+    bool didStart() const override { return m_started; }
+
+    int getWidth() const override { return m_width; }
+    int getHeight() const override { return m_height; }
+    // The negotiated V4L2 fourcc (V4L2_PIX_FMT_YUYV, _NV12 or _MJPEG).
+    uint32_t getPixelFormat() const { return m_pixelFormat; }
+
+    bool isFrameNew(uint64_t lastSequence) const override { return m_signal.isNew(lastSequence); }
+    bool waitForFrame(uint64_t lastSequence, int timeoutMs, int64_t& timestampNs, uint64_t& sequence) override {
+        return m_signal.wait(lastSequence, timeoutMs, timestampNs, sequence);
+    }
+    bool getPixels(unsigned char* dst, bool rgb, bool flipX, bool flipY, uint64_t& lastSequence) override;
+
+private:
+    struct Buffer {
+        void* start = nullptr;
+        size_t length = 0;
+    };
+    // a dequeued driver buffer, -1 when the slot holds none
+    struct Frame {
+        int index = -1;
+        uint32_t bytesUsed = 0;
+    };
+
+    bool negotiate();
+    bool mapBuffers();
+    void unmapBuffers();
+    bool queue(int index);
+    void requeue(int index);
+    void run();
+    bool convert(const Frame& frame, unsigned char* dst, bool rgb, bool flipX, bool flipY);
+
+    std::string m_path;
+    int m_requestedWidth;
+    int m_requestedHeight;
+    int m_requestedFps;
+
+    int m_fd = -1;
+    int m_width = 0;
+    int m_height = 0;
+    uint32_t m_pixelFormat = 0;
+    uint32_t m_bytesPerLine = 0;
+    size_t m_frameBytes = 0;  // bytes an uncompressed frame must fill, 0 for MJPEG
+    std::atomic<bool> m_started{false};
+    std::vector<Buffer> m_buffers;
+
+    std::thread m_thread;
+    std::atomic<bool> m_stop{false};
+
+    TripleBuffer<Frame> m_frames;
+    FrameSignal m_signal;
+
+    // consumer side, guarded by m_consumerMutex; the poll thread never takes it
+    std::mutex m_consumerMutex;
+    AVCodecContext* m_decoder = nullptr;
+    AVFrame* m_decoded = nullptr;
+    AVPacket* m_packet = nullptr;
+    SwsContext* m_sws = nullptr;
+    std::vector<unsigned char> m_converted;  // BGR24 / RGB24 before a flip
+};
+#endif
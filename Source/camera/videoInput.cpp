@@ -33,6 +33,12 @@
 
 #include "utils.h"
 #include "VI.h"
+#include "pixel_kernels.h"
+#include "triple_buffer.h"
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 
 // Due to a missing qedit.h in recent Platform SDKs, we've replicated the relevant contents here
 // #include <qedit.h>
@@ -103,25 +109,14 @@ class SampleGrabberCallback : public ISampleGrabberCB {
 public:
     //------------------------------------------------
     SampleGrabberCallback() {
-        InitializeCriticalSection(&critSection);
         freezeCheck = 0;
 
         bufferSetup = false;
-        newFrame = false;
         latestBufferLength = 0;
-
-        hEvent = CreateEvent(NULL, true, false, NULL);
     }
 
     //------------------------------------------------
-    ~SampleGrabberCallback() {
-        ptrBuffer = NULL;
-        DeleteCriticalSection(&critSection);
-        CloseHandle(hEvent);
-        if (bufferSetup) {
-            delete[] pixels;
-        }
-    }
+    ~SampleGrabberCallback() { ptrBuffer = NULL; }
 
     //------------------------------------------------
     bool setupBuffer(int numBytesIn) {
@@ -129,9 +124,9 @@ public:
             return false;
         } else {
             numBytes = numBytesIn;
-            pixels = new unsigned char[numBytes];
+            for (int i = 0; i < 3; i++) frames.slot(i).value.resize(numBytes);
+            for (Conversion& conversion : conversions) conversion = Conversion();
             bufferSetup = true;
-            newFrame = false;
             latestBufferLength = 0;
         }
         return true;
@@ -149,20 +144,22 @@ public:
 
     // This method is meant to have less overhead
     //------------------------------------------------
+    // Never waits for the consumer, a frame it has not picked up yet is replaced by the newer one.
     STDMETHODIMP SampleCB(double /*Time*/, IMediaSample* pSample) {
-        if (WaitForSingleObject(hEvent, 0) == WAIT_OBJECT_0) return S_OK;
-
         HRESULT hr = pSample->GetPointer(&ptrBuffer);
 
         if (hr == S_OK) {
             latestBufferLength = pSample->GetActualDataLength();
             if (latestBufferLength == numBytes) {
-                EnterCriticalSection(&critSection);
-                memcpy(pixels, ptrBuffer, latestBufferLength);
-                newFrame = true;
+                memcpy(frames.back().value.data(), ptrBuffer, latestBufferLength);
+                int64_t timestampNs = TripleBuffer<std::vector<unsigned char>>::Now();
+                uint64_t sequence = frames.publish(timestampNs);
                 freezeCheck = 1;
-                LeaveCriticalSection(&critSection);
-                SetEvent(hEvent);
+                latestTimestampNs.store(timestampNs, std::memory_order_relaxed);
+                latestSequence.store(sequence, std::memory_order_release);
+                // empty critical section: a waiter between its check and its wait cannot miss the notification
+                { std::lock_guard<std::mutex> lock(waitMutex); }
+                frameArrived.notify_all();
             } else {
                 Utils::LoggerPrintf(VI::LogLevel::Error, "ERROR: SampleCB() - buffer sizes do not match\n");
             }
@@ -171,19 +168,46 @@ public:
         return S_OK;
     }
 
+    // Waits until a frame other than lastSequence has been published, compared with != as a restarted device
+    // starts counting again.
+    bool waitForFrame(uint64_t lastSequence, int timeoutMs) {
+        std::unique_lock<std::mutex> lock(waitMutex);
+        return frameArrived.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&]() {
+            uint64_t sequence = latestSequence.load(std::memory_order_acquire);
+            return sequence != 0 && sequence != lastSequence;
+        });
+    }
+
     // This method is meant to have more overhead
     STDMETHODIMP BufferCB(double /*Time*/, BYTE* /*pBuffer*/, long /*BufferLen*/) { return E_NOTIMPL; }
 
-    int freezeCheck;
+    std::atomic<int> freezeCheck;
 
     int latestBufferLength;
     int numBytes;
-    bool newFrame;
     bool bufferSetup;
-    unsigned char* pixels;
+    TripleBuffer<std::vector<unsigned char>> frames;
+    // serializes the consumers (several getPixels callers), the capture callback never takes it
+    std::mutex consumerMutex;
+
+    // One per (channel order, flipX, flipY), guarded by consumerMutex. A conversion that two consumers asked
+    // for on the previous frame is written to the first consumer's buffer and to pixels in the same pass, and
+    // the others copy it from there. Otherwise pixels stays empty, a single consumer converts straight into
+    // its own buffer.
+    struct Conversion {
+        uint64_t sequence = 0;  // last frame it was asked for
+        int requests = 0;       // on that frame
+        bool shared = false;    // pixels holds it for that frame
+        std::vector<unsigned char> pixels;
+    };
+    Conversion conversions[8];
     unsigned char* ptrBuffer;
-    CRITICAL_SECTION critSection;
-    HANDLE hEvent;
+
+    // newest published frame, for the waiters; the capture thread only holds waitMutex to notify them
+    std::atomic<uint64_t> latestSequence{0};
+    std::atomic<int64_t> latestTimestampNs{0};
+    std::mutex waitMutex;
+    std::condition_variable frameArrived;
 };
 
 //////////////////////////////  VIDEO DEVICE  ////////////////////////////////
@@ -207,7 +231,6 @@ videoDevice::videoDevice() {
 
     // This is our callback class that processes the frame.
     sgCallback = new SampleGrabberCallback();
-    sgCallback->newFrame = false;
 
     // Default values for capture type
     videoType = MEDIASUBTYPE_RGB24;
@@ -221,6 +244,7 @@ videoDevice::videoDevice() {
     tryHeight = 0;
     nFramesForReconnect = 10000;
     nFramesRunning = 0;
+    lastSequence = 0;
     myID = -1;
 
     tryDiffSize = false;
@@ -936,29 +960,52 @@ int videoInput::getSize(int id) {
 // ----------------------------------------------------------------------
 
 bool videoInput::getPixels(int id, unsigned char* dstBuffer, bool flipRedAndBlue, bool flipX, bool flipY) {
+    if (!isDeviceSetup(id)) return false;
+    return getPixels(id, dstBuffer, flipRedAndBlue, flipX, flipY, VDList[id]->lastSequence);
+}
+
+bool videoInput::getPixels(int id, unsigned char* dstBuffer, bool flipRedAndBlue, bool flipX, bool flipY, uint64_t& lastSequence) {
     bool success = false;
 
     if (isDeviceSetup(id)) {
         if (bCallback) {
             // callback capture
 
-            DWORD result = WaitForSingleObject(VDList[id]->sgCallback->hEvent, 1000);
-            if (result != WAIT_OBJECT_0) return false;
+            SampleGrabberCallback* callback = VDList[id]->sgCallback;
+            // returns at once when another consumer already took a frame this one has not seen
+            if (!callback->waitForFrame(lastSequence, 1000)) return false;
 
-            // double paranoia - mutexing with both event and critical section
-            EnterCriticalSection(&VDList[id]->sgCallback->critSection);
+            std::lock_guard<std::mutex> lock(callback->consumerMutex);
+            callback->frames.update();
 
-            unsigned char* src = VDList[id]->sgCallback->pixels;
-            unsigned char* dst = dstBuffer;
-            int height = VDList[id]->height;
+            auto& frame = callback->frames.front();
+            unsigned char* src = frame.value.data();
             int width = VDList[id]->width;
+            int height = VDList[id]->height;
 
-            processPixels(src, dst, width, height, flipRedAndBlue, flipX, flipY);
-            VDList[id]->sgCallback->newFrame = false;
-
-            LeaveCriticalSection(&VDList[id]->sgCallback->critSection);
-
-            ResetEvent(VDList[id]->sgCallback->hEvent);
+            SampleGrabberCallback::Conversion& conversion = callback->conversions[(flipRedAndBlue ? 1 : 0) | (flipX ? 2 : 0) | (flipY ? 4 : 0)];
+            if (conversion.sequence != frame.sequence) {
+                // first consumer of this conversion on this frame
+                conversion.shared = conversion.requests > 1;
+                conversion.sequence = frame.sequence;
+                conversion.requests = 1;
+                if (conversion.shared) {
+                    conversion.pixels.resize((size_t)width * height * 3);
+                    processPixels(src, dstBuffer, width, height, flipRedAndBlue, flipX, flipY, conversion.pixels.data());
+                } else {
+                    std::vector<unsigned char>().swap(conversion.pixels);
+                    processPixels(src, dstBuffer, width, height, flipRedAndBlue, flipX, flipY);
+                }
+            } else {
+                conversion.requests++;
+                if (conversion.shared) {
+                    memcpy(dstBuffer, conversion.pixels.data(), (size_t)width * height * 3);
+                } else {
+                    // a second consumer nobody expected, the copy is kept from the next frame on
+                    processPixels(src, dstBuffer, width, height, flipRedAndBlue, flipX, flipY);
+                }
+            }
+            lastSequence = frame.sequence;
 
             success = true;
 
@@ -988,6 +1035,23 @@ bool videoInput::getPixels(int id, unsigned char* dstBuffer, bool flipRedAndBlue
     return success;
 }
 
+// ----------------------------------------------------------------------
+// Blocks on the capture callback, without callbacks frames are always there
+// ----------------------------------------------------------------------
+bool videoInput::waitForFrame(int id, uint64_t lastSequence, int timeoutMs, int64_t& timestampNs, uint64_t& sequence) {
+    if (!isDeviceSetup(id)) return false;
+    timestampNs = TripleBuffer<std::vector<unsigned char>>::Now();
+    // without the callback every call sees a new frame
+    sequence = lastSequence + 1;
+    if (!bCallback) return true;
+
+    SampleGrabberCallback* callback = VDList[id]->sgCallback;
+    if (!callback->waitForFrame(lastSequence, timeoutMs)) return false;
+    sequence = callback->latestSequence.load(std::memory_order_acquire);
+    timestampNs = callback->latestTimestampNs.load(std::memory_order_relaxed);
+    return true;
+}
+
 // ----------------------------------------------------------------------
 // Returns a buffer
 // ----------------------------------------------------------------------
@@ -1010,9 +1074,7 @@ bool videoInput::isFrameNew(int id) {
     bool result = false;
     bool freeze = false;
 
-    // again super paranoia!
-    EnterCriticalSection(&VDList[id]->sgCallback->critSection);
-    result = VDList[id]->sgCallback->newFrame;
+    result = VDList[id]->sgCallback->frames.hasNew();
 
     // we need to give it some time at the begining to start up so lets check after 400 frames
     if (VDList[id]->nFramesRunning > 400 && VDList[id]->sgCallback->freezeCheck > VDList[id]->nFramesForReconnect) {
@@ -1023,7 +1085,6 @@ bool videoInput::isFrameNew(int id) {
     // so as long as the callback is running this var should never get too high.
     // if the callback is not running then this number will get high and trigger the freeze action below
     VDList[id]->sgCallback->freezeCheck++;
-    LeaveCriticalSection(&VDList[id]->sgCallback->critSection);
 
     VDList[id]->nFramesRunning++;
 
@@ -1491,43 +1552,9 @@ bool videoInput::setup(int deviceNumber) {
 // You have any combination of those.
 // ----------------------------------------------------------------------
 
-void videoInput::processPixels(unsigned char* src, unsigned char* dst, int width, int height, bool bRGB, bool bFlipX, bool bFlipY) {
+void videoInput::processPixels(unsigned char* src, unsigned char* dst, int width, int height, bool bRGB, bool bFlipX, bool bFlipY, unsigned char* copy) {
     int widthInBytes = width * 3;
-    int numBytes = widthInBytes * height;
-
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            unsigned char* srcPtr = NULL;
-            if (bFlipX) {
-                if (bFlipY) {
-                    srcPtr = src + (widthInBytes * (height - y) - 3 * (x + 1));
-                } else {
-                    srcPtr = src + ((widthInBytes * (y + 1)) - 3 * (x + 1));
-                }
-            } else {
-                if (bFlipY) {
-                    srcPtr = src + widthInBytes * (height - 1 - y) + 3 * x;
-                } else {
-                    srcPtr = src + widthInBytes * y + 3 * x;
-                }
-            }
-            if (bRGB) {
-                *dst = *(srcPtr + 2);
-                dst++;
-                *dst = *(srcPtr + 1);
-                dst++;
-                *dst = *srcPtr;
-                dst++;
-            } else {
-                *dst = *srcPtr;
-                dst++;
-                *dst = *(srcPtr + 1);
-                dst++;
-                *dst = *(srcPtr + 2);
-                dst++;
-            }
-        }
-    }
+    Pixels::ConvertPackedTee(src, widthInBytes, dst, copy, widthInBytes, width, height, 3, bRGB, bFlipX, bFlipY);
 }
 
 //------------------------------------------------------------------------------------------
@@ -46,6 +46,7 @@ Thanks to:
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <stdint.h>
 #include <wchar.h>
 #include <string>
 #include <vector>
@@ -229,6 +230,7 @@ public:
     bool autoReconnect;
     int nFramesForReconnect;
     unsigned long nFramesRunning;
+    uint64_t lastSequence;  // last frame handed out by the getPixels overload without a consumer sequence
     int connection;
     int storeConn;
     int myID;
@@ -308,6 +310,15 @@ public:
     // Or pass in a buffer for getPixels to fill returns true if successful.
     bool getPixels(int id, unsigned char* pixels, bool flipRedAndBlue = true, bool flipX = true, bool flipY = true);
 
+    // Same as above for one of several consumers sharing the device: waits for a frame other than lastSequence
+    // (the one this consumer got last time) and updates it. In callback mode a conversion several consumers ask
+    // for is made once per frame and copied to the others.
+    bool getPixels(int id, unsigned char* pixels, bool flipRedAndBlue, bool flipX, bool flipY, uint64_t& lastSequence);
+
+    // Blocks until the capture callback publishes a frame other than lastSequence, false on timeout.
+    // timestampNs receives the capture time of that frame (steady clock), sequence its sequence.
+    bool waitForFrame(int id, uint64_t lastSequence, int timeoutMs, int64_t& timestampNs, uint64_t& sequence);
+
     // Launches a pop up settings window
     // For some reason in GLUT you have to call it twice each time.
     void showSettingsWindow(int deviceID);
@@ -361,7 +372,8 @@ private:
     void setPhyCon(int deviceID, int conn);
     void setAttemptCaptureSize(int deviceID, int w, int h);
     bool setup(int deviceID);
-    void processPixels(unsigned char* src, unsigned char* dst, int width, int height, bool bRGB, bool bFlipX, bool bFlipY);
+    // copy, when given, receives the same pixels as dst in the same pass
+    void processPixels(unsigned char* src, unsigned char* dst, int width, int height, bool bRGB, bool bFlipX, bool bFlipY, unsigned char* copy = NULL);
     int start(int deviceID, videoDevice* VD);
     int getDeviceCount();
     void getMediaSubtypeAsString(GUID type, char* typeAsString);
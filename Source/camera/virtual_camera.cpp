@@ -0,0 +1,113 @@
+#include "virtual_camera.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include "pixel_kernels.h"
+#include "utils.h"
+
+VirtualCamera::VirtualCamera(const Params& params) : m_params(params) {}
+
+VirtualCamera::~VirtualCamera() { stop(); }
+
+bool VirtualCamera::start() {
+    if (m_started) return true;
+    if (!m_params.file.empty()) {
+        m_video.reset(new VI::Video(VI::String(m_params.file.c_str(), m_params.file.size())));
+        if (!m_video->isOpened()) {
+            Utils::LoggerPrintf(VI::LogLevel::Error, "VirtualCamera: unable to open %s\n", m_params.file.c_str());
+            m_video.reset();
+            return false;
+        }
+        m_width = m_video->getWidth();
+        m_height = m_video->getHeight();
+    } else {
+        m_width = m_params.width;
+        m_height = m_params.height;
+    }
+    if (m_width <= 0 || m_height <= 0) return false;
+
+    for (int i = 0; i < 3; i++) m_frames.slot(i).value.resize((size_t)m_width * m_height * 3);
+    m_stop = false;
+    m_thread = std::thread(&VirtualCamera::run, this);
+    m_started = true;
+    return true;
+}
+
+void VirtualCamera::stop() {
+    if (!m_started) return;
+    m_stop = true;
+    m_thread.join();
+    m_video.reset();
+    m_started = false;
+}
+
+bool VirtualCamera::getPixels(unsigned char* dst, bool rgb, bool flipX, bool flipY, uint64_t& lastSequence) {
+    int64_t timestampNs;
+    uint64_t sequence;
+    if (!m_started || !waitForFrame(lastSequence, 1000, timestampNs, sequence)) return false;
+
+    std::lock_guard<std::mutex> lock(m_consumerMutex);
+    m_frames.update();
+    auto& frame = m_frames.front();
+    int stride = m_width * 3;
+    Pixels::ConvertPacked(frame.value.data(), stride, dst, stride, m_width, m_height, 3, rgb, flipX, flipY);
+    lastSequence = frame.sequence;
+    return true;
+}
+
+void VirtualCamera::DrawPattern(unsigned char* bgr, int width, int height, uint64_t index) {
+    for (int y = 0; y < height; y++) {
+        unsigned char* row = bgr + (size_t)y * width * 3;
+        unsigned char green = (unsigned char)(y * 255 / std::max(height - 1, 1));
+        for (int x = 0; x < width; x++) {
+            row[x * 3 + 0] = (unsigned char)(x + index);
+            row[x * 3 + 1] = green;
+            row[x * 3 + 2] = (unsigned char)(index * 4);
+        }
+    }
+}
+
+void VirtualCamera::run() {
+    double fps = m_params.fps > 0 ? m_params.fps : (m_video ? m_video->getFPS() : 0);
+    if (fps <= 0) fps = 30;
+    const int64_t periodNs = (int64_t)(1e9 / fps);
+    std::mt19937 random(std::random_device{}());
+    std::normal_distribution<double> jitter(0, m_params.jitterMs * 1e6);
+
+    int64_t start = TripleBuffer<int>::Now();
+    for (uint64_t index = 0; !m_stop.load(std::memory_order_relaxed); index++) {
+        // producing the frame counts against its period, like the sensor readout of a real camera
+        unsigned char* data = m_frames.back().value.data();
+        if (m_video) {
+            bool grabbed = m_video->grab();
+            if (!grabbed) {
+                m_video->seekFrame(0);
+                grabbed = m_video->grab();
+            }
+            if (!grabbed || !m_video->retrieve(data, m_width * 3, VI::PixelFormat::BGR24)) {
+                Utils::LoggerPrintf(VI::LogLevel::Error, "VirtualCamera: unable to read %s\n", m_params.file.c_str());
+                break;
+            }
+        } else {
+            DrawPattern(data, m_width, m_height, index);
+        }
+
+        // the jitter stays within half a period, so deliveries never swap places
+        int64_t offset = m_params.jitterMs > 0 ? std::max<int64_t>(-periodNs / 2, std::min<int64_t>(periodNs / 2, (int64_t)jitter(random))) : 0;
+        int64_t due = start + (int64_t)index * periodNs + offset;
+        int64_t now = TripleBuffer<int>::Now();
+        if (now > due + periodNs) {
+            // fell behind (slow decode, suspended process): restart the schedule instead of bursting
+            start += now - due;
+            due = now;
+        }
+        while (now < due && !m_stop.load(std::memory_order_relaxed)) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(std::min<int64_t>(due - now, 10000000)));
+            now = TripleBuffer<int>::Now();
+        }
+        if (m_stop.load(std::memory_order_relaxed)) break;
+
+        int64_t timestampNs = TripleBuffer<int>::Now();
+        m_signal.notify(m_frames.publish(timestampNs), timestampNs);
+    }
+}
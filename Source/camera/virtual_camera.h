@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "camera_source.h"
+#include "triple_buffer.h"
+#include "VI.h"
+
+// A camera without hardware: a capture thread plays a video file in a loop or draws a test pattern and
+// publishes BGR24 frames at the requested rate, each delivery off its nominal time by a random jitter.
+// Consumers go through the same triple buffer handoff and pixel kernels as the hardware backends.
+class VirtualCamera : public CameraSource {
+public:
+    struct Params {
+        std::string file;  // empty for the generated pattern
+        int width = 640;   // pattern size, a file plays at its own size
+        int height = 480;
+        double fps = 30;  // 0 plays a file at its own rate
+        double jitterMs = 1;
+    };
+
+    VirtualCamera(const Params& params);
+    ~VirtualCamera();
+
+    bool start() override;
+    void stop() override;
+    bool didStart() const override { return m_started; }
+
+    int getWidth() const override { return m_width; }
+    int getHeight() const override { return m_height; }
+
+    bool isFrameNew(uint64_t lastSequence) const override { return m_signal.isNew(lastSequence); }
+    bool waitForFrame(uint64_t lastSequence, int timeoutMs, int64_t& timestampNs, uint64_t& sequence) override {
+        return m_signal.wait(lastSequence, timeoutMs, timestampNs, sequence);
+    }
+    bool getPixels(unsigned char* dst, bool rgb, bool flipX, bool flipY, uint64_t& lastSequence) override;
+
+    // Draws frame index of the generated pattern, a gradient that moves one pixel per frame.
+    static void DrawPattern(unsigned char* bgr, int width, int height, uint64_t index);
+
+private:
+    void run();
+
+    Params m_params;
+    std::unique_ptr<VI::Video> m_video;
+    int m_width = 0;
+    int m_height = 0;
+    std::atomic<bool> m_started{false};
+
+    std::thread m_thread;
+    std::atomic<bool> m_stop{false};
+
+    TripleBuffer<std::vector<unsigned char>> m_frames;
+    // serializes the consumers, the capture thread never takes it
+    std::mutex m_consumerMutex;
+    FrameSignal m_signal;
+};
@@ -0,0 +1,181 @@
+#include "trace.h"
+#include "utils.h"
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <stdio.h>
+
+namespace Utils {
+
+std::atomic<bool> TraceEnabledFlag{false};
+
+struct TraceEventData {
+    const char* name;
+    int64_t begin;
+    int64_t end;
+    int64_t frame;
+};
+
+// One ring slot under a seqlock: a dump may read a slot while its owner overwrites it once the ring
+// wrapped, the copy only counts when sequence read index + 1 before and after the fields.
+struct TraceRecord {
+    std::atomic<uint64_t> sequence{0};  // index + 1 of the event in the slot, 0 while it is rewritten
+    std::atomic<const char*> name{nullptr};
+    std::atomic<int64_t> begin{0};
+    std::atomic<int64_t> end{0};
+    std::atomic<int64_t> frame{0};
+
+    void write(uint64_t index, const TraceEventData& event) {
+        sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        name.store(event.name, std::memory_order_relaxed);
+        begin.store(event.begin, std::memory_order_relaxed);
+        end.store(event.end, std::memory_order_relaxed);
+        frame.store(event.frame, std::memory_order_relaxed);
+        sequence.store(index + 1, std::memory_order_release);
+    }
+
+    bool read(uint64_t index, TraceEventData& event) const {
+        if (sequence.load(std::memory_order_acquire) != index + 1) return false;
+        event.name = name.load(std::memory_order_relaxed);
+        event.begin = begin.load(std::memory_order_relaxed);
+        event.end = end.load(std::memory_order_relaxed);
+        event.frame = frame.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return sequence.load(std::memory_order_relaxed) == index + 1;
+    }
+};
+
+// Written by its thread only, the newest events overwrite the oldest once the ring is full.
+struct TraceBuffer {
+    static const size_t Capacity = 1 << 15;
+    // guarded by TraceBuffersMutex
+    uint32_t thread = 0;
+    uint64_t finished = 0;  // exit order of its thread, 0 while the thread runs
+    // the ClearTrace epoch the records belong to, the owner resets its ring when it falls behind
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<uint64_t> written{0};
+    std::unique_ptr<TraceRecord[]> records{new TraceRecord[Capacity]};
+};
+
+// Buffers outlive their threads so that a dump still sees the events of finished workers, the last
+// KeptFinishedBuffers of them. Older finished buffers are handed to new threads, so threads that come
+// and go (decode workers, extraction segments, async opens) do not grow the trace memory.
+static const size_t KeptFinishedBuffers = 8;
+static std::mutex TraceBuffersMutex;
+static std::vector<std::unique_ptr<TraceBuffer>> TraceBuffers;
+static uint32_t TraceThreadCount = 0;
+static uint64_t TraceFinishedCount = 0;
+static std::atomic<uint64_t> TraceEpoch{0};
+
+static TraceBuffer* AcquireTraceBuffer() {
+    std::lock_guard<std::mutex> lock(TraceBuffersMutex);
+    TraceBuffer* buffer = nullptr;
+    size_t finished = 0;
+    for (auto& candidate : TraceBuffers) {
+        if (!candidate->finished) continue;
+        finished++;
+        if (!buffer || candidate->finished < buffer->finished) buffer = candidate.get();
+    }
+    if (finished < KeptFinishedBuffers) {
+        TraceBuffers.emplace_back(new TraceBuffer());
+        buffer = TraceBuffers.back().get();
+    }
+    // a new tid, the viewer must not merge the reused buffer with the events of its previous thread
+    buffer->thread = ++TraceThreadCount;
+    buffer->finished = 0;
+    buffer->written.store(0, std::memory_order_relaxed);
+    buffer->epoch.store(TraceEpoch.load(std::memory_order_relaxed), std::memory_order_release);
+    return buffer;
+}
+
+// Hands the thread's buffer back when the thread exits.
+struct TraceBufferOwner {
+    TraceBuffer* buffer = nullptr;
+    ~TraceBufferOwner() {
+        if (!buffer) return;
+        std::lock_guard<std::mutex> lock(TraceBuffersMutex);
+        buffer->finished = ++TraceFinishedCount;
+    }
+};
+
+static TraceBuffer* GetThreadTraceBuffer() {
+    thread_local TraceBufferOwner owner;
+    if (!owner.buffer) owner.buffer = AcquireTraceBuffer();
+    return owner.buffer;
+}
+
+void SetTraceEnabled(bool enabled) { TraceEnabledFlag.store(enabled, std::memory_order_relaxed); }
+
+void TraceEvent(const char* name, int64_t begin_ns, int64_t end_ns, int64_t frame) {
+    TraceBuffer* buffer = GetThreadTraceBuffer();
+    uint64_t index = buffer->written.load(std::memory_order_relaxed);
+    uint64_t epoch = TraceEpoch.load(std::memory_order_acquire);
+    if (buffer->epoch.load(std::memory_order_relaxed) != epoch) {
+        // cleared since the last event; the reset is published before the new epoch, a dump that sees
+        // the epoch never sees the old count
+        index = 0;
+        buffer->written.store(0, std::memory_order_relaxed);
+        buffer->epoch.store(epoch, std::memory_order_release);
+    }
+    buffer->records[index % TraceBuffer::Capacity].write(index, TraceEventData{name, begin_ns, end_ns, frame});
+    buffer->written.store(index + 1, std::memory_order_release);
+}
+
+// Running threads reset their own buffer on their next event, storing written here could be undone by an
+// owner between its load and its store. Until then the dump skips their old records by epoch.
+void ClearTrace() {
+    std::lock_guard<std::mutex> lock(TraceBuffersMutex);
+    uint64_t epoch = TraceEpoch.fetch_add(1, std::memory_order_acq_rel) + 1;
+    for (auto& buffer : TraceBuffers) {
+        if (!buffer->finished) continue;
+        buffer->written.store(0, std::memory_order_relaxed);
+        buffer->epoch.store(epoch, std::memory_order_release);
+    }
+}
+
+// The number of records of the current epoch in buffer, 0 for a buffer its thread has not reset yet.
+static uint64_t CurrentWritten(const TraceBuffer& buffer) {
+    if (buffer.epoch.load(std::memory_order_acquire) != TraceEpoch.load(std::memory_order_relaxed)) return 0;
+    return buffer.written.load(std::memory_order_acquire);
+}
+
+bool DumpTrace(const std::string& path) {
+#ifdef _WIN32
+    FILE* file = _wfopen(MultiByteToWideCharString(path.c_str()).c_str(), L"wb");
+#else
+    FILE* file = fopen(path.c_str(), "wb");
+#endif
+    if (!file) return false;
+
+    // every buffer is copied once, records its thread overwrote meanwhile are dropped
+    std::vector<std::pair<uint32_t, TraceEventData>> events;
+    {
+        std::lock_guard<std::mutex> lock(TraceBuffersMutex);
+        for (auto& buffer : TraceBuffers) {
+            uint64_t written = CurrentWritten(*buffer);
+            for (uint64_t i = written > TraceBuffer::Capacity ? written - TraceBuffer::Capacity : 0; i < written; i++) {
+                TraceEventData event;
+                if (buffer->records[i % TraceBuffer::Capacity].read(i, event)) events.emplace_back(buffer->thread, event);
+            }
+        }
+    }
+    // timestamps are relative to the oldest event so the viewer starts at zero
+    int64_t origin = INT64_MAX;
+    for (auto& event : events) origin = std::min(origin, event.second.begin);
+
+    fprintf(file, "{\"traceEvents\":[");
+    bool first = true;
+    for (auto& entry : events) {
+        const TraceEventData& event = entry.second;
+        fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f", first ? "" : ",", event.name, entry.first, (event.begin - origin) / 1000.0, (event.end - event.begin) / 1000.0);
+        if (event.frame >= 0) fprintf(file, ",\"args\":{\"frame\":%lld}", (long long)event.frame);
+        fprintf(file, "}");
+        first = false;
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    return fclose(file) == 0;
+}
+
+}  // namespace Utils
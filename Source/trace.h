@@ -0,0 +1,39 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace Utils {
+
+extern std::atomic<bool> TraceEnabledFlag;
+
+// A single relaxed load, instrumentation costs nothing else while tracing is off.
+inline bool TraceEnabled() { return TraceEnabledFlag.load(std::memory_order_relaxed); }
+
+inline int64_t TraceNow() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+void SetTraceEnabled(bool enabled);
+
+// Records a complete event [begin_ns, end_ns] of the calling thread, name must be a string literal.
+void TraceEvent(const char* name, int64_t begin_ns, int64_t end_ns, int64_t frame = -1);
+
+// Writes the events of every thread as Chrome trace JSON (chrome://tracing, Perfetto).
+bool DumpTrace(const std::string& path);
+void ClearTrace();
+
+class TraceScope {
+public:
+    TraceScope(const char* name, int64_t frame = -1) : m_name(name), m_frame(frame), m_begin(TraceEnabled() ? TraceNow() : 0) {}
+    ~TraceScope() {
+        if (m_begin && TraceEnabled()) TraceEvent(m_name, m_begin, TraceNow(), m_frame);
+    }
+    void setFrame(int64_t frame) { m_frame = frame; }
+
+private:
+    const char* m_name;
+    int64_t m_frame;
+    int64_t m_begin;
+};
+
+}  // namespace Utils
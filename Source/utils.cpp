@@ -1,6 +1,15 @@
 ﻿#include "utils.h"
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <string.h>
 #ifdef _WIN32
 #include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
 #endif
 
 namespace Utils {
@@ -18,13 +27,188 @@ public:
     }
 };
 
-VI::Logger* GlobalLoggerFunction = NULL;
+std::atomic<VI::Logger*> GlobalLoggerFunction{NULL};
 
-void SetGlobalLogger(VI::Logger* logger) { GlobalLoggerFunction = logger; }
+// Held by the asynchronous sink around every delivery, so that a replaced logger is no longer in use once
+// SetGlobalLogger returns.
+static std::mutex LogDeliveryMutex;
+
+void SetGlobalLogger(VI::Logger* logger) {
+    // queued messages still go to the logger they were logged under, the caller may free it right after
+    FlushLog();
+    std::lock_guard<std::mutex> lock(LogDeliveryMutex);
+    GlobalLoggerFunction.store(logger, std::memory_order_release);
+}
 
 VI::Logger* GetGlobalLogger() {
     static DefaultLogger GlobalDefaultLogger;
-    return GlobalLoggerFunction ? GlobalLoggerFunction : &GlobalDefaultLogger;
+    VI::Logger* logger = GlobalLoggerFunction.load(std::memory_order_acquire);
+    return logger ? logger : &GlobalDefaultLogger;
+}
+
+std::atomic<int> GlobalLogLevel{static_cast<int>(VI::LogLevel::Info)};
+
+void SetLogLevel(VI::LogLevel level) { GlobalLogLevel.store(static_cast<int>(level), std::memory_order_relaxed); }
+
+// Bounded multi-producer ring (one sequence number per slot), producers never take a lock or wait
+// for the delivering thread. Longer messages are truncated to the slot size. Created once and never
+// freed, a producer may still hold the pointer; its thread runs between start() and stop().
+class AsyncLogSink {
+public:
+    static const size_t SlotCount = 1024;
+    static const size_t MessageSize = 1024;
+
+    AsyncLogSink() : m_slots(new Slot[SlotCount]) {
+        for (size_t i = 0; i < SlotCount; i++) m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    ~AsyncLogSink() { stop(); }
+
+    // Callers hold AsyncLogMutex.
+    void start() {
+        if (m_thread.joinable()) return;
+        m_stop.store(false, std::memory_order_relaxed);
+#ifdef _WIN32
+        // The thread holds a reference to this module and drops it as it exits, a FreeLibrary while it
+        // runs leaves the library loaded instead of unmapping the code the thread executes.
+        HMODULE module = NULL;
+        GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, reinterpret_cast<LPCWSTR>(&SetAsyncLogging), &module);
+        m_thread = std::thread([this, module]() {
+            run();
+            if (module) FreeLibraryAndExitThread(module, 0);
+        });
+#else
+        m_thread = std::thread([this]() { run(); });
+#endif
+    }
+
+    // Joins the delivering thread, messages it has not delivered stay queued for the next start().
+    // Callers hold AsyncLogMutex.
+    void stop() {
+        if (!m_thread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop.store(true, std::memory_order_release);
+        }
+        m_cond.notify_one();
+        m_thread.join();
+    }
+
+    void push(VI::LogLevel level, const char* msg) {
+        uint64_t position = m_tail.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &m_slots[position % SlotCount];
+            uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+            if (sequence == position) {
+                if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            } else if (sequence < position) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                position = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+        slot->level = level;
+        strncpy(slot->message, msg, MessageSize - 1);
+        slot->message[MessageSize - 1] = 0;
+        slot->sequence.store(position + 1, std::memory_order_release);
+        // no lock here, the consumer also wakes up on its own every few milliseconds
+        m_cond.notify_one();
+    }
+
+    void flush() {
+        uint64_t target = m_tail.load(std::memory_order_acquire);
+        while (m_head.load(std::memory_order_acquire) < target && !m_stop.load(std::memory_order_acquire)) {
+            m_cond.notify_one();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence;
+        VI::LogLevel level;
+        char message[MessageSize];
+    };
+
+    void run() {
+        while (!m_stop.load(std::memory_order_acquire)) {
+            bool delivered = false;
+            std::unique_lock<std::mutex> delivery(LogDeliveryMutex);
+            for (;;) {
+                uint64_t position = m_head.load(std::memory_order_relaxed);
+                Slot& slot = m_slots[position % SlotCount];
+                if (slot.sequence.load(std::memory_order_acquire) != position + 1) break;
+                GetGlobalLogger()->onMessage(slot.level, slot.message);
+                slot.sequence.store(position + SlotCount, std::memory_order_release);
+                m_head.store(position + 1, std::memory_order_release);
+                delivered = true;
+            }
+            size_t dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+            if (dropped) {
+                std::string message = fmt::format("{} log messages dropped, the asynchronous log ring was full\n", dropped);
+                GetGlobalLogger()->onMessage(VI::LogLevel::Warning, message.c_str());
+            }
+            delivery.unlock();
+            if (delivered) continue;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_stop.load(std::memory_order_relaxed)) break;
+            m_cond.wait_for(lock, std::chrono::milliseconds(5));
+        }
+    }
+
+    std::unique_ptr<Slot[]> m_slots;
+    std::atomic<uint64_t> m_head{0};
+    std::atomic<uint64_t> m_tail{0};
+    std::atomic<size_t> m_dropped{0};
+    std::atomic<bool> m_stop{false};
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+};
+
+static std::mutex AsyncLogMutex;
+static AsyncLogSink* AsyncLog = nullptr;
+static std::atomic<AsyncLogSink*> AsyncLogActive{nullptr};
+
+void SetAsyncLogging(bool enabled) {
+    std::lock_guard<std::mutex> lock(AsyncLogMutex);
+    if (enabled) {
+        if (!AsyncLog) AsyncLog = new AsyncLogSink();
+        AsyncLog->start();
+        AsyncLogActive.store(AsyncLog, std::memory_order_release);
+    } else if (AsyncLog) {
+        // producers that already loaded the pointer may still push, so the sink is drained, not destroyed
+        AsyncLogActive.store(nullptr, std::memory_order_release);
+        AsyncLog->flush();
+        AsyncLog->stop();
+    }
+}
+
+// Stops the delivering thread when the library is unloaded or the process exits, before the code it runs
+// goes away. Nothing is flushed, the logger may already be destroyed. On Windows the thread keeps the DLL
+// loaded, so this only runs once it is gone or at process exit.
+static struct AsyncLogShutdown {
+    ~AsyncLogShutdown() {
+        std::lock_guard<std::mutex> lock(AsyncLogMutex);
+        AsyncLogActive.store(nullptr, std::memory_order_release);
+        if (AsyncLog) AsyncLog->stop();
+    }
+} AsyncLogShutdownGuard;
+
+void FlushLog() {
+    AsyncLogSink* sink = AsyncLogActive.load(std::memory_order_acquire);
+    if (sink) sink->flush();
+}
+
+void LogMessage(VI::LogLevel level, const char* msg) {
+    AsyncLogSink* sink = AsyncLogActive.load(std::memory_order_acquire);
+    if (sink) {
+        sink->push(level, msg);
+    } else {
+        GetGlobalLogger()->onMessage(level, msg);
+    }
 }
 
 #ifdef _WIN32
@@ -38,5 +222,68 @@ std::string WideCharToMultiByteString(const wchar_t* wszBuffer) {
     delete[] szBuffer;
     return result;
 }
+
+std::wstring MultiByteToWideCharString(const char* szBuffer) {
+    std::wstring result;
+    int nLen = MultiByteToWideChar(CP_UTF8, NULL, szBuffer, -1, NULL, NULL);
+    WCHAR* wszBuffer = new WCHAR[nLen + 1];
+    nLen = MultiByteToWideChar(CP_UTF8, NULL, szBuffer, -1, wszBuffer, nLen);
+    wszBuffer[nLen] = 0;
+    result = std::wstring(wszBuffer);
+    delete[] wszBuffer;
+    return result;
+}
 #endif
+
+void AddLatencySample(VI::LatencyHistogram& histogram, int64_t ns) {
+    uint64_t value = (uint64_t)std::max<int64_t>(ns, 0);
+    int bucket = 0;
+    for (uint64_t rest = value >> 1; rest && bucket < VI::LatencyHistogram::BucketCount - 1; rest >>= 1) bucket++;
+    histogram.buckets[bucket]++;
+    histogram.count++;
+    histogram.totalNs += value;
+    if (value > histogram.maxNs) histogram.maxNs = value;
+}
+
+static void ListDirectory(const std::string& directory, bool recursive, std::vector<std::string>& files) {
+#ifdef _WIN32
+    WIN32_FIND_DATAW data;
+    HANDLE handle = FindFirstFileW(MultiByteToWideCharString((directory + "/*").c_str()).c_str(), &data);
+    if (handle == INVALID_HANDLE_VALUE) return;
+    do {
+        std::string name = WideCharToMultiByteString(data.cFileName);
+        if (name == "." || name == "..") continue;
+        std::string path = directory + "/" + name;
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            if (recursive) ListDirectory(path, recursive, files);
+        } else {
+            files.push_back(path);
+        }
+    } while (FindNextFileW(handle, &data));
+    FindClose(handle);
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") continue;
+        std::string path = directory + "/" + name;
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) continue;
+        if (S_ISDIR(info.st_mode)) {
+            if (recursive) ListDirectory(path, recursive, files);
+        } else if (S_ISREG(info.st_mode)) {
+            files.push_back(path);
+        }
+    }
+    closedir(dir);
+#endif
+}
+
+std::vector<std::string> ListDirectory(const std::string& directory, bool recursive) {
+    std::vector<std::string> files;
+    ListDirectory(directory, recursive, files);
+    std::sort(files.begin(), files.end());
+    return files;
+}
 }  // namespace Utils
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include <string>
 #include <memory>
 #include <functional>
+#include <vector>
+#include <atomic>
 #include "fmt/core.h"
 #include "fmt/printf.h"
 #include "VI.h"
@@ -14,38 +16,57 @@ void SetGlobalLogger(VI::Logger* logger);
 
 VI::Logger* GetGlobalLogger();
 
+extern std::atomic<int> GlobalLogLevel;
+
+// Checked before anything is formatted, a filtered message costs one relaxed load.
+inline bool LogEnabled(VI::LogLevel level) { return static_cast<int>(level) >= GlobalLogLevel.load(std::memory_order_relaxed); }
+
+void SetLogLevel(VI::LogLevel level);
+
+// Hands a formatted message to the logger, or to the background sink when asynchronous logging is on.
+void LogMessage(VI::LogLevel level, const char* msg);
+
+// Messages are queued in a lock-free ring and delivered by a background thread, a full ring drops messages.
+void SetAsyncLogging(bool enabled);
+// Waits until every queued message has been delivered, hangs when called from the delivering thread
+// (inside Logger::onMessage).
+void FlushLog();
+
 #ifdef _WIN32
 std::string WideCharToMultiByteString(const wchar_t* wszBuffer);
+std::wstring MultiByteToWideCharString(const char* szBuffer);
 #endif
 
+// Adds one sample to a log2 histogram, cheap enough for every packet.
+void AddLatencySample(VI::LatencyHistogram& histogram, int64_t ns);
+
+// Regular files of a directory as UTF-8 paths, sorted by name.
+std::vector<std::string> ListDirectory(const std::string& directory, bool recursive);
+
 template <typename... T>
 void LoggerPrintf(VI::LogLevel level, const char* fmtStr, T&&... args) {
+    if (!LogEnabled(level)) return;
     std::string content = fmt::sprintf(fmtStr, args...);
-    GetGlobalLogger()->onMessage(static_cast<VI::LogLevel>(level), content.c_str());
+    LogMessage(level, content.c_str());
 }
 }  // namespace Utils
 
-#define CV_LOG_INFO(flag, stream)                                  \
-    {                                                              \
-        std::ostringstream ss;                                     \
-        ss << stream << std::endl;                                 \
-        Utils::LoggerPrintf(VI::LogLevel::Info, ss.str().c_str()); \
-    }
-#define CV_LOG_DEBUG(flag, stream)                                 \
-    {                                                              \
-        std::ostringstream ss;                                     \
-        ss << stream << std::endl;                                 \
-        Utils::LoggerPrintf(VI::LogLevel::Info, ss.str().c_str()); \
-    }
-#define CV_LOG_ERROR(flag, stream)                                  \
-    {                                                               \
-        std::ostringstream ss;                                      \
-        ss << stream << std::endl;                                  \
-        Utils::LoggerPrintf(VI::LogLevel::Error, ss.str().c_str()); \
-    }
-#define CV_LOG_WARN(flag, stream)                                     \
-    {                                                                 \
-        std::ostringstream ss;                                        \
-        ss << stream << std::endl;                                    \
-        Utils::LoggerPrintf(VI::LogLevel::Warning, ss.str().c_str()); \
+#define CV_LOG_WITH_LEVEL(level, stream)                \
+    {                                                   \
+        if (Utils::LogEnabled(level)) {                 \
+            std::ostringstream ss;                      \
+            ss << stream << std::endl;                  \
+            Utils::LogMessage(level, ss.str().c_str()); \
+        }                                               \
     }
+
+#define CV_LOG_INFO(flag, stream) CV_LOG_WITH_LEVEL(VI::LogLevel::Info, stream)
+#define CV_LOG_ERROR(flag, stream) CV_LOG_WITH_LEVEL(VI::LogLevel::Error, stream)
+#define CV_LOG_WARN(flag, stream) CV_LOG_WITH_LEVEL(VI::LogLevel::Warning, stream)
+// Compiled out of release builds unless VI_DEBUG_LOG is defined.
+#if defined(NDEBUG) && !defined(VI_DEBUG_LOG)
+#define CV_LOG_DEBUG(flag, stream) \
+    {}
+#else
+#define CV_LOG_DEBUG(flag, stream) CV_LOG_WITH_LEVEL(VI::LogLevel::Debug, stream)
+#endif
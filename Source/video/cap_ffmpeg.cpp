@@ -43,6 +43,35 @@ enum VideoCaptureAPIs {
     CAP_UEYE = 2500,              //!< uEye Camera API
 };
 
+static VI::PixelFormat ToPixelFormat(int format) {
+    switch (format) {
+        case AV_PIX_FMT_BGR24: return VI::PixelFormat::BGR24;
+        case AV_PIX_FMT_RGB24: return VI::PixelFormat::RGB24;
+        case AV_PIX_FMT_BGRA: return VI::PixelFormat::BGRA;
+        case AV_PIX_FMT_RGBA: return VI::PixelFormat::RGBA;
+        case AV_PIX_FMT_GRAY8: return VI::PixelFormat::GRAY8;
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUVJ420P: return VI::PixelFormat::YUV420P;
+        case AV_PIX_FMT_YUV422P:
+        case AV_PIX_FMT_YUVJ422P: return VI::PixelFormat::YUV422P;
+        case AV_PIX_FMT_YUV444P:
+        case AV_PIX_FMT_YUVJ444P: return VI::PixelFormat::YUV444P;
+        case AV_PIX_FMT_NV12: return VI::PixelFormat::NV12;
+        default: return VI::PixelFormat::Unknown;
+    }
+}
+
+static AVPixelFormat ToAVPixelFormat(VI::PixelFormat format) {
+    switch (format) {
+        case VI::PixelFormat::BGR24: return AV_PIX_FMT_BGR24;
+        case VI::PixelFormat::RGB24: return AV_PIX_FMT_RGB24;
+        case VI::PixelFormat::BGRA: return AV_PIX_FMT_BGRA;
+        case VI::PixelFormat::RGBA: return AV_PIX_FMT_RGBA;
+        case VI::PixelFormat::GRAY8: return AV_PIX_FMT_GRAY8;
+        default: return AV_PIX_FMT_NONE;
+    }
+}
+
 class CvCapture_FFMPEG_proxy : public IVideoCapture {
 public:
     CvCapture_FFMPEG_proxy() { ffmpegCapture = 0; }
@@ -52,6 +81,14 @@ public:
     virtual double getProperty(int propId) const override { return ffmpegCapture ? cvGetCaptureProperty_FFMPEG(ffmpegCapture, propId) : 0; }
     virtual bool setProperty(int propId, double value) override { return ffmpegCapture ? cvSetCaptureProperty_FFMPEG(ffmpegCapture, propId, value) != 0 : false; }
     virtual bool grabFrame() override { return ffmpegCapture ? cvGrabFrame_FFMPEG(ffmpegCapture) != 0 : false; }
+    virtual bool getStats(VI::VideoStats& stats) const override {
+        if (!ffmpegCapture) return false;
+        stats = ffmpegCapture->stats;
+        return true;
+    }
+    virtual bool grabFrameAt(double sec) override { return ffmpegCapture ? ffmpegCapture->grabFrameAt(sec) : false; }
+    virtual bool getSegments(int count, std::vector<int64_t>& starts) override { return ffmpegCapture ? ffmpegCapture->getSegments(count, starts) : false; }
+    virtual bool decodeSegment(int64_t start, int64_t end, const std::function<bool(int64_t, double)>& on_frame) override { return ffmpegCapture ? ffmpegCapture->decodeSegment(start, end, on_frame) : false; }
     virtual bool retrieveFrame(int, IVideoCaptureFrame& frame, bool rgb) override {
         unsigned char* data = 0;
         int step = 0, width = 0, height = 0, cn = 0;
@@ -94,6 +131,50 @@ public:
 
     virtual bool isOpened() const override { return ffmpegCapture != 0; }
 
+    virtual std::shared_ptr<void> refFrameBuffer() override {
+        AVBufferRef* buffer = ffmpegCapture ? ffmpegCapture->refOutputBuffer() : NULL;
+        if (!buffer) return nullptr;
+        return std::shared_ptr<void>(buffer, [](void* ref) {
+            AVBufferRef* buffer = (AVBufferRef*)ref;
+            av_buffer_unref(&buffer);
+        });
+    }
+
+    virtual bool retrieveDecoded(IVideoCapturePlanes& planes) override {
+        AVFrame* decoded = ffmpegCapture ? ffmpegCapture->refDecodedFrame() : NULL;
+        if (!decoded) return false;
+        planes.planes = std::max(0, std::min(4, av_pix_fmt_count_planes((AVPixelFormat)decoded->format)));
+        for (int i = 0; i < planes.planes; i++) {
+            planes.data[i] = decoded->data[i];
+            planes.step[i] = decoded->linesize[i];
+        }
+        planes.width = decoded->width;
+        planes.height = decoded->height;
+        planes.cn = 0;
+        planes.format = ToPixelFormat(decoded->format);
+        planes.buffer = std::shared_ptr<void>(decoded, [](void* ref) {
+            AVFrame* decoded = (AVFrame*)ref;
+            av_frame_free(&decoded);
+        });
+        return true;
+    }
+
+    virtual bool retrieveFrameInto(unsigned char* dst, int step, VI::PixelFormat format) override {
+        AVPixelFormat dst_format = ToAVPixelFormat(format);
+        if (!ffmpegCapture || dst_format == AV_PIX_FMT_NONE) return false;
+        return ffmpegCapture->retrieveFrameInto(dst, step, dst_format);
+    }
+
+    virtual void setInterruptFlag(const std::atomic<bool>* flag) override {
+#if USE_AV_INTERRUPT_CALLBACK
+        if (ffmpegCapture) {
+            ffmpegCapture->interrupt_metadata.abort_request = flag;
+        }
+#else
+        CV_UNUSED(flag);
+#endif
+    }
+
 protected:
     CvCapture_FFMPEG* ffmpegCapture;
 };
@@ -104,3 +185,21 @@ IVideoCapture* cvCreateFileCapture_FFMPEG_proxy(const std::string& filename, con
     delete capture;
     return nullptr;
 }
+
+bool cvProbeFile_FFMPEG_proxy(const std::string& filename, const VideoCaptureParameters& params, VideoProbeResult& result) { return cvProbeFile_FFMPEG(filename.c_str(), params, result); }
+
+void cvSetDecoderPoolCapacity_FFMPEG_proxy(size_t capacity) {
+#if USE_AV_DECODER_POOL
+    DecoderContextPool::instance().setCapacity(capacity);
+#else
+    CV_UNUSED(capacity);
+#endif
+}
+
+DecoderPoolCounters cvGetDecoderPoolStats_FFMPEG_proxy() {
+#if USE_AV_DECODER_POOL
+    return DecoderContextPool::instance().counters();
+#else
+    return DecoderPoolCounters();
+#endif
+}
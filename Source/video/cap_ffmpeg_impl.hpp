@@ -1,8 +1,14 @@
 #include "cap_ffmpeg_legacy_api.hpp"
 #include "utils.h"
+#include "trace.h"
 #include <assert.h>
 #include <algorithm>
 #include <limits>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <chrono>
 #include "videoio.hpp"
 
 #ifndef __OPENCV_BUILD
@@ -37,8 +43,6 @@ extern "C" {
 
 #include <libavcodec/avcodec.h>
 #include <libswscale/swscale.h>
-#include <libavfilter/buffersink.h>
-#include <libavfilter/buffersrc.h>
 #include <libavutil/opt.h>
 }
 
@@ -69,6 +73,9 @@ extern "C" {
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#if defined __linux__
+#include <sys/mman.h>
+#endif
 #if defined __APPLE__
 #include <sys/sysctl.h>
 #include <mach/clock.h>
@@ -107,6 +114,20 @@ extern "C" {
 #endif
 #endif
 
+// decoders supporting direct rendering can decode into application memory through get_buffer2
+#if LIBAVCODEC_BUILD >= CALC_FFMPEG_VERSION(58, 0, 100)
+#define USE_AV_FRAME_ALLOCATOR 1
+#else
+#define USE_AV_FRAME_ALLOCATOR 0
+#endif
+
+// converted frames are taken from an AVBufferPool (custom allocator through av_buffer_pool_init2)
+#if LIBAVUTIL_BUILD >= CALC_FFMPEG_VERSION(56, 14, 100)
+#define USE_AV_OUTPUT_POOL 1
+#else
+#define USE_AV_OUTPUT_POOL 0
+#endif
+
 #ifndef USE_AV_INTERRUPT_CALLBACK
 #define USE_AV_INTERRUPT_CALLBACK 1
 #endif
@@ -120,6 +141,15 @@ extern "C" {
 #endif
 #endif
 
+#ifndef USE_AV_DECODER_POOL
+// decoding on a private AVCodecContext (instead of the deprecated AVStream::codec) is what allows reusing it
+#if LIBAVFORMAT_BUILD >= CALC_FFMPEG_VERSION(58, 20, 100)
+#define USE_AV_DECODER_POOL 1
+#else
+#define USE_AV_DECODER_POOL 0
+#endif
+#endif
+
 #if USE_AV_INTERRUPT_CALLBACK
 #define LIBAVFORMAT_INTERRUPT_OPEN_DEFAULT_TIMEOUT_MS 30000
 #define LIBAVFORMAT_INTERRUPT_READ_DEFAULT_TIMEOUT_MS 30000
@@ -265,6 +295,7 @@ struct AVInterruptCallbackMetadata {
     timespec value;
     unsigned int timeout_after_ms;
     int timeout;
+    const std::atomic<bool>* abort_request;  // owned by the caller, aborts I/O regardless of the timeout
 };
 
 // https://github.com/opencv/opencv/pull/12693#issuecomment-426236731
@@ -299,6 +330,11 @@ static inline int _opencv_ffmpeg_interrupt_callback(void* ptr) {
     AVInterruptCallbackMetadata* metadata = (AVInterruptCallbackMetadata*)ptr;
     assert(metadata);
 
+    if (metadata->abort_request && metadata->abort_request->load(std::memory_order_relaxed)) {
+        metadata->timeout = 1;
+        return -1;
+    }
+
     if (metadata->timeout_after_ms == 0) {
         return 0;  // timeout is disabled
     }
@@ -356,18 +392,289 @@ static AVRational _opencv_ffmpeg_get_sample_aspect_ratio(AVStream* stream) {
 #endif
 }
 
+#if LIBAVFORMAT_BUILD >= CALC_FFMPEG_VERSION(58, 20, 100)
+// true when the demuxer header alone gives everything needed to open the first video stream
+static bool _opencv_ffmpeg_header_describes_video(AVFormatContext* ic) {
+    if (ic->ctx_flags & AVFMTCTX_NOHEADER) return false;
+    for (unsigned i = 0; i < ic->nb_streams; i++) {
+        AVStream* st = ic->streams[i];
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+            return st->codecpar->codec_id != AV_CODEC_ID_NONE && st->codecpar->width > 0 && st->codecpar->height > 0 && st->avg_frame_rate.num > 0 && st->avg_frame_rate.den > 0;
+        }
+    }
+    return false;
+}
+#endif
+
+#if USE_AV_DECODER_POOL
+// Everything that makes two opened decoders interchangeable: same decoder, same stream parameters, same settings.
+struct DecoderPoolKey {
+    const AVCodec* codec;
+    CV_CODEC_ID codec_id;
+    unsigned int codec_tag;
+    int format;
+    int width;
+    int height;
+    int profile;
+    int level;
+    int bits_per_coded_sample;
+    int extradata_size;
+    uint64_t extradata_hash;
+    // Not owned: the stream's extradata while the key is looked up, the pooled decoder's own copy once it is idle.
+    const uint8_t* extradata;
+    int thread_count;
+    AVDiscard skip_frame;
+
+    static DecoderPoolKey make(const AVCodec* codec, const AVCodecParameters* par, const AVCodecContext* context) {
+        DecoderPoolKey key;
+        memset(&key, 0, sizeof(key));
+        key.codec = codec;
+        key.codec_id = par->codec_id;
+        key.codec_tag = par->codec_tag;
+        key.format = par->format;
+        key.width = par->width;
+        key.height = par->height;
+        key.profile = par->profile;
+        key.level = par->level;
+        key.bits_per_coded_sample = par->bits_per_coded_sample;
+        key.extradata_size = par->extradata_size;
+        // FNV-1a, SPS/PPS and similar headers must match byte for byte
+        key.extradata_hash = 14695981039346656037ULL;
+        for (int i = 0; i < par->extradata_size; i++) {
+            key.extradata_hash = (key.extradata_hash ^ par->extradata[i]) * 1099511628211ULL;
+        }
+        key.extradata = par->extradata;
+        key.thread_count = context->thread_count;
+        key.skip_frame = context->skip_frame;
+        return key;
+    }
+
+    bool operator==(const DecoderPoolKey& other) const {
+        return codec == other.codec && codec_id == other.codec_id && codec_tag == other.codec_tag && format == other.format && width == other.width && height == other.height && profile == other.profile && level == other.level &&
+               bits_per_coded_sample == other.bits_per_coded_sample && extradata_size == other.extradata_size && extradata_hash == other.extradata_hash && thread_count == other.thread_count && skip_frame == other.skip_frame &&
+               // the hash only rules out most mismatches, a collision must not hand out a decoder set up for other headers
+               (extradata_size == 0 || memcmp(extradata, other.extradata, extradata_size) == 0);
+    }
+};
+
+// Process-wide cache of opened software decoders, so opening many files with identical parameters
+// skips avcodec_find_decoder/avcodec_open2 and the decoder thread start-up.
+class DecoderContextPool {
+public:
+    static DecoderContextPool& instance() {
+        static DecoderContextPool pool;
+        return pool;
+    }
+
+    ~DecoderContextPool() { setCapacity(0); }
+
+    AVCodecContext* checkout(const DecoderPoolKey& key) {
+        AVCodecContext* context = NULL;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            // a disabled pool neither looks nor counts
+            if (counters_.capacity == 0) return NULL;
+            for (auto it = idle_.rbegin(); it != idle_.rend(); ++it) {
+                if (it->first == key) {
+                    context = it->second;
+                    idle_.erase(std::next(it).base());
+                    break;
+                }
+            }
+            if (context)
+                counters_.hits++;
+            else
+                counters_.misses++;
+        }
+        // drop the reference frames and any frame left from the previous file
+        if (context) avcodec_flush_buffers(context);
+        return context;
+    }
+
+    void checkin(const DecoderPoolKey& key, AVCodecContext* context) {
+        // the stream's extradata goes away with the file, an idle decoder is matched against the copy it holds
+        DecoderPoolKey idleKey = key;
+        idleKey.extradata = context->extradata;
+        bool matches = context->extradata_size == key.extradata_size && (key.extradata_size == 0 || context->extradata);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (counters_.capacity > 0 && matches) {
+                idle_.emplace_back(idleKey, context);
+                context = NULL;
+                if (idle_.size() > counters_.capacity) {
+                    // least recently returned first
+                    context = idle_.front().second;
+                    idle_.erase(idle_.begin());
+                    counters_.evictions++;
+                }
+            }
+        }
+        if (context) avcodec_free_context(&context);
+    }
+
+    void setCapacity(size_t capacity) {
+        std::vector<AVCodecContext*> evicted;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            counters_.capacity = capacity;
+            while (idle_.size() > capacity) {
+                evicted.push_back(idle_.front().second);
+                idle_.erase(idle_.begin());
+                counters_.evictions++;
+            }
+        }
+        for (auto context : evicted) avcodec_free_context(&context);
+    }
+
+    DecoderPoolCounters counters() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        DecoderPoolCounters result = counters_;
+        result.idle = idle_.size();
+        return result;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::pair<DecoderPoolKey, AVCodecContext*>> idle_;
+    DecoderPoolCounters counters_;
+};
+#endif
+
+#if USE_AV_OUTPUT_POOL
+#if LIBAVUTIL_VERSION_MAJOR < 57
+typedef int ffmpeg_buffer_size_t;
+#else
+typedef size_t ffmpeg_buffer_size_t;
+#endif
+
+// rows of converted frames start on a cache line / widest SIMD register boundary
+#define OUTPUT_BUFFER_ALIGN 64
+#define OUTPUT_BUFFER_HUGE_PAGE (2 * 1024 * 1024)
+
+static void _opencv_ffmpeg_output_buffer_free(void*, uint8_t* data) {
+#if defined _WIN32
+    _aligned_free(data);
+#else
+    free(data);
+#endif
+}
+
+// opaque is non-NULL when the buffers should be backed by transparent huge pages
+static AVBufferRef* _opencv_ffmpeg_output_buffer_alloc(void* opaque, ffmpeg_buffer_size_t size) {
+    size_t align = OUTPUT_BUFFER_ALIGN, alloc_size = size;
+#if defined __linux__ && defined MADV_HUGEPAGE
+    if (opaque && alloc_size >= OUTPUT_BUFFER_HUGE_PAGE) {
+        align = OUTPUT_BUFFER_HUGE_PAGE;
+        alloc_size = (alloc_size + align - 1) / align * align;
+    }
+#else
+    CV_UNUSED(opaque);
+#endif
+    void* data = NULL;
+#if defined _WIN32
+    data = _aligned_malloc(alloc_size, align);
+#else
+    if (posix_memalign(&data, align, alloc_size) != 0) data = NULL;
+#endif
+    if (!data) return NULL;
+#if defined __linux__ && defined MADV_HUGEPAGE
+    if (align == OUTPUT_BUFFER_HUGE_PAGE) madvise(data, alloc_size, MADV_HUGEPAGE);
+#endif
+    AVBufferRef* buffer = av_buffer_create((uint8_t*)data, size, _opencv_ffmpeg_output_buffer_free, NULL, 0);
+    if (!buffer) _opencv_ffmpeg_output_buffer_free(NULL, (uint8_t*)data);
+    return buffer;
+}
+#endif
+
+#if USE_AV_FRAME_ALLOCATOR
+#define DECODE_BUFFER_ALIGN 64
+
+static void _opencv_ffmpeg_frame_allocator_release(void* opaque, uint8_t* data) { ((VI::FrameAllocator*)opaque)->release(data); }
+
+// get_buffer2 callback placing the decoded planes into memory of the application's VI::FrameAllocator (context->opaque)
+static int _opencv_ffmpeg_frame_allocator_get_buffer2(AVCodecContext* context, AVFrame* frame, int flags) {
+    VI::FrameAllocator* allocator = (VI::FrameAllocator*)context->opaque;
+    AVPixelFormat format = (AVPixelFormat)frame->format;
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(format);
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL))) return avcodec_default_get_buffer2(context, frame, flags);
+
+    // decoders write past the visible size (macroblock alignment, edges), the same padding the default allocator uses
+    int width = frame->width, height = frame->height;
+    int aligns[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(context, &width, &height, aligns);
+
+    int linesizes[4];
+    if (av_image_fill_linesizes(linesizes, format, width) < 0) return AVERROR(EINVAL);
+    for (int i = 0; i < 4; i++) linesizes[i] = FFALIGN(linesizes[i], DECODE_BUFFER_ALIGN);
+
+    uint8_t* planes[4];
+    int size = av_image_fill_pointers(planes, format, height, NULL, linesizes);
+    if (size < 0) return size;
+    // SIMD readers may overread the end of the last row
+    size += 16 + DECODE_BUFFER_ALIGN - 1;
+
+    uint8_t* data = (uint8_t*)allocator->allocate(size, DECODE_BUFFER_ALIGN);
+    if (!data) return avcodec_default_get_buffer2(context, frame, flags);
+    frame->buf[0] = av_buffer_create(data, size, _opencv_ffmpeg_frame_allocator_release, allocator, 0);
+    if (!frame->buf[0]) {
+        allocator->release(data);
+        return AVERROR(ENOMEM);
+    }
+    av_image_fill_pointers(frame->data, format, height, data, linesizes);
+    for (int i = 0; i < 4; i++) frame->linesize[i] = linesizes[i];
+    frame->extended_data = frame->data;
+    return 0;
+}
+#endif
+
+static inline int64_t _opencv_ffmpeg_now_ns() { return Utils::TraceNow(); }
+
+// Adds the time elapsed since start_ns to a log2 histogram and emits the same interval as a trace event
+// when tracing is enabled.
+static inline void _opencv_ffmpeg_record_latency(VI::LatencyHistogram& histogram, int64_t start_ns, const char* name, int64_t frame) {
+    int64_t end_ns = _opencv_ffmpeg_now_ns();
+    if (Utils::TraceEnabled()) Utils::TraceEvent(name, start_ns, end_ns, frame);
+    Utils::AddLatencySample(histogram, end_ns - start_ns);
+}
+
+// Turns a packed width x height picture clockwise by angle (90, 180 or 270) into dst, which has the
+// rotated size. Runs only for clips with rotation metadata, a plain per-pixel copy is enough.
+static void _opencv_ffmpeg_rotate_packed(const uint8_t* src, int src_step, int width, int height, int bpp, uint8_t* dst, int dst_step, int angle) {
+    int dst_width = angle == 180 ? width : height, dst_height = angle == 180 ? height : width;
+    for (int y = 0; y < dst_height; y++) {
+        uint8_t* row = dst + (size_t)y * dst_step;
+        for (int x = 0; x < dst_width; x++) {
+            int sx = angle == 90 ? y : angle == 180 ? width - 1 - x : width - 1 - y;
+            int sy = angle == 90 ? height - 1 - x : angle == 180 ? height - 1 - y : x;
+            memcpy(row + (size_t)x * bpp, src + (size_t)sy * src_step + (size_t)sx * bpp, bpp);
+        }
+    }
+}
+
 struct CvCapture_FFMPEG {
     bool open(const char* filename, const VideoCaptureParameters& params);
+    bool probe(const char* filename, const VideoCaptureParameters& params, VideoProbeResult& result);
     void close();
 
+    bool applyParameters(const char* filename, const VideoCaptureParameters& params);
+    int openInput(const char* filename, const VideoCaptureParameters& params);
+
     double getProperty(int) const;
     bool setProperty(int, double);
     bool grabFrame();
+    bool grabFrameAt(double sec);
+    bool getSegments(int count, std::vector<int64_t>& starts);
+    bool decodeSegment(int64_t start, int64_t end, const std::function<bool(int64_t, double)>& on_frame);
+    void promoteSampleFrame();
     bool retrieveFrame(int, unsigned char** data, int* step, int* width, int* height, int* cn, bool rgb);
+    AVBufferRef* refOutputBuffer();
+    bool retrieveFrameInto(unsigned char* dst, int dst_step, AVPixelFormat dst_format);
+    AVFrame* refDecodedFrame();
 
     void init();
 
     void seek(int64_t frame_number);
+    void seekFrame_(int64_t frame_number);
     void seek(double sec);
     bool slowSeek(int framenumber);
 
@@ -380,23 +687,49 @@ struct CvCapture_FFMPEG {
     int64_t dts_to_frame_number(int64_t dts);
     double dts_to_sec(int64_t dts) const;
     void get_rotation_angle();
+    // rotation_angle snapped to 0, 90, 180 or 270, 0 when rotation_auto is off
+    int display_rotation() const;
 
     AVFormatContext* ic;
     AVCodec* avcodec;
+    AVCodecContext* context;
     int video_stream;
     AVStream* video_st;
     AVFrame* picture;
+    AVDiscard skip_frame_base;
+
+    // monotonic per-stage counters, reset by open()
+    VI::VideoStats stats;
+
+    // temporal sampling: the frame decoded ahead of the one on screen, and the hint letting the
+    // decoder drop non-reference frames that end before the next sampling point
+    AVFrame* sample_next;
+    int64_t sample_next_pts;
+    bool sample_next_valid;
+    bool sample_skipping;
+    double sample_skip_until;
+    double sample_frame_duration;
     AVFrame rgb_picture;
+#if USE_AV_OUTPUT_POOL
+    AVBufferPool* output_pool;
+    int output_pool_size;
+#endif
+    int output_format;
+    bool output_huge_pages;
     int64_t picture_pts;
 
     AVPacket packet;
     Image_FFMPEG frame;
     struct SwsContext* img_convert_ctx;
+    struct SwsContext* dst_convert_ctx;
 
     int64_t frame_number, first_frame_number;
 
     bool rotation_auto;
     int rotation_angle;  // valid 0, 90, 180, 270
+    // retrieveFrameInto output before it is rotated, grown with av_fast_malloc
+    uint8_t* rotate_buffer;
+    unsigned int rotate_buffer_size;
     double eps_zero;
     /*
        'filename' contains the filename of the videosource,
@@ -427,21 +760,50 @@ struct CvCapture_FFMPEG {
     VideoAccelerationType va_type;
     int hw_device;
     int use_opencl;
+
+    int probe_size;
+    int analyze_duration;
+    bool trust_container_header;
+    VI::FrameAllocator* frame_allocator;
+    int decoder_threads;
+
+#if USE_AV_DECODER_POOL
+    DecoderPoolKey decoder_key;
+    bool decoder_poolable;
+#endif
 };
 
 void CvCapture_FFMPEG::init() {
     ic = 0;
+    context = 0;
     video_stream = -1;
     video_st = 0;
     picture = 0;
     picture_pts = AV_NOPTS_VALUE_;
     first_frame_number = -1;
+    skip_frame_base = AVDISCARD_DEFAULT;
+    stats = VI::VideoStats();
+    sample_next = NULL;
+    sample_next_pts = AV_NOPTS_VALUE_;
+    sample_next_valid = false;
+    sample_skipping = false;
+    sample_skip_until = 0;
+    sample_frame_duration = 0;
     memset(&rgb_picture, 0, sizeof(rgb_picture));
+#if USE_AV_OUTPUT_POOL
+    output_pool = NULL;
+    output_pool_size = 0;
+#endif
+    output_format = AV_PIX_FMT_NONE;
+    output_huge_pages = false;
     memset(&frame, 0, sizeof(frame));
     filename = 0;
     memset(&packet, 0, sizeof(packet));
     av_init_packet(&packet);
     img_convert_ctx = 0;
+    dst_convert_ctx = 0;
+    rotate_buffer = NULL;
+    rotate_buffer_size = 0;
 
     avcodec = 0;
     frame_number = 0;
@@ -459,6 +821,7 @@ void CvCapture_FFMPEG::init() {
 #if USE_AV_INTERRUPT_CALLBACK
     open_timeout = LIBAVFORMAT_INTERRUPT_OPEN_DEFAULT_TIMEOUT_MS;
     read_timeout = LIBAVFORMAT_INTERRUPT_READ_DEFAULT_TIMEOUT_MS;
+    memset(&interrupt_metadata, 0, sizeof(interrupt_metadata));
 #endif
 
     rawMode = false;
@@ -469,14 +832,36 @@ void CvCapture_FFMPEG::init() {
     va_type = VIDEO_ACCELERATION_NONE;  // TODO OpenCV 5.0: change to _ANY?
     hw_device = -1;
     use_opencl = 0;
+
+    probe_size = 0;
+    analyze_duration = 0;
+    trust_container_header = false;
+    frame_allocator = NULL;
+    decoder_threads = 0;
+
+#if USE_AV_DECODER_POOL
+    memset(&decoder_key, 0, sizeof(decoder_key));
+    decoder_poolable = false;
+#endif
 }
 
 void CvCapture_FFMPEG::close() {
+    if (dst_convert_ctx) {
+        sws_freeContext(dst_convert_ctx);
+        dst_convert_ctx = 0;
+    }
+    av_freep(&rotate_buffer);
+    rotate_buffer_size = 0;
+
     if (img_convert_ctx) {
         sws_freeContext(img_convert_ctx);
         img_convert_ctx = 0;
     }
 
+#if USE_AV_SEND_FRAME_API
+    av_frame_free(&sample_next);
+#endif
+
     if (picture) {
 #if LIBAVCODEC_BUILD >= (LIBAVCODEC_VERSION_MICRO >= 100 ? CALC_FFMPEG_VERSION(55, 45, 101) : CALC_FFMPEG_VERSION(55, 28, 1))
         av_frame_free(&picture);
@@ -487,10 +872,18 @@ void CvCapture_FFMPEG::close() {
 #endif
     }
 
-    if (video_st) {
-        avcodec_close(video_st->codec);
-        video_st = NULL;
+    if (context) {
+#if USE_AV_DECODER_POOL
+        if (decoder_poolable)
+            DecoderContextPool::instance().checkin(decoder_key, context);
+        else
+            avcodec_free_context(&context);
+#else
+        avcodec_close(context);
+#endif
+        context = NULL;
     }
+    video_st = NULL;
 
     if (ic) {
         avformat_close_input(&ic);
@@ -499,6 +892,10 @@ void CvCapture_FFMPEG::close() {
 
 #if USE_AV_FRAME_GET_BUFFER
     av_frame_unref(&rgb_picture);
+#if USE_AV_OUTPUT_POOL
+    // buffers still referenced by the application keep the pool alive until they are released
+    av_buffer_pool_uninit(&output_pool);
+#endif
 #else
     if (rgb_picture.data[0]) {
         free(rgb_picture.data[0]);
@@ -690,25 +1087,41 @@ static int LockCallBack(void** mutex, AVLockOp op) {
     return 0;
 }
 
+// libav messages go to the VI logger, both level checks happen before the message is formatted.
 static void ffmpeg_log_callback(void* ptr, int level, const char* fmt, va_list vargs) {
-    static bool skip_header = false;
-    static int prev_level = -1;
-    CV_UNUSED(ptr);
+    // whether the next message starts a line, per thread: decoder threads log concurrently and a message
+    // without a trailing newline must not take the prefix off another thread's line
+    static thread_local int print_prefix = 1;
     if (level > av_log_get_level()) return;
-    if (!skip_header || level != prev_level) printf("[OPENCV:FFMPEG:%02d] ", level);
-    vprintf(fmt, vargs);
-    size_t fmt_len = strlen(fmt);
-    skip_header = fmt_len > 0 && fmt[fmt_len - 1] != '\n';
-    prev_level = level;
+    VI::LogLevel vi_level = level <= AV_LOG_ERROR ? VI::LogLevel::Error : level <= AV_LOG_WARNING ? VI::LogLevel::Warning : level <= AV_LOG_INFO ? VI::LogLevel::Info : VI::LogLevel::Debug;
+    if (!Utils::LogEnabled(vi_level)) return;
+    char line[1024];
+    av_log_format_line(ptr, level, fmt, vargs, line, sizeof(line), &print_prefix);
+    Utils::LogMessage(vi_level, line);
 }
 
 class InternalFFMpegRegister {
 public:
-    static void init() {
+    // Only the pieces the given input needs are initialized: the network stack is brought up
+    // the first time a network URL is opened, local files never pay for it.
+    static void init(const char* filename = NULL) {
         AutoLock lock(_mutex);
         static InternalFFMpegRegister instance;
+        if (filename && isNetworkInput_(filename)) initNetwork_();
         initLogger_();  // update logger setup unconditionally (GStreamer's libav plugin may override these settings)
     }
+    static bool isNetworkInput_(const char* filename) {
+        const char* scheme_end = strstr(filename, "://");
+        if (!scheme_end) return false;
+        return !(scheme_end - filename == 4 && strncmp(filename, "file", 4) == 0);
+    }
+    static void initNetwork_() {
+        static bool initialized = false;
+        if (!initialized) {
+            avformat_network_init();
+            initialized = true;
+        }
+    }
     static void initLogger_() {
 #ifndef NO_GETENV
         char* debug_option = getenv("OPENCV_FFMPEG_DEBUG");
@@ -719,18 +1132,16 @@ public:
         }
         if ((debug_option != NULL) || (level_option != NULL)) {
             av_log_set_level(level);
-            av_log_set_callback(ffmpeg_log_callback);
         } else
 #endif
         {
             av_log_set_level(AV_LOG_ERROR);
         }
+        av_log_set_callback(ffmpeg_log_callback);
     }
 
 public:
     InternalFFMpegRegister() {
-        avformat_network_init();
-
         /* register all codecs, demux and protocols */
         av_register_all();
 
@@ -743,16 +1154,7 @@ public:
     }
 };
 
-bool CvCapture_FFMPEG::open(const char* _filename, const VideoCaptureParameters& params) {
-    InternalFFMpegRegister::init();
-
-    AutoLock lock(_mutex);
-
-    unsigned i;
-    bool valid = false;
-
-    close();
-
+bool CvCapture_FFMPEG::applyParameters(const char* _filename, const VideoCaptureParameters& params) {
     if (!params.empty()) {
         if (params.has(CAP_PROP_FORMAT)) {
             int value = params.get<int>(CAP_PROP_FORMAT);
@@ -795,14 +1197,34 @@ bool CvCapture_FFMPEG::open(const char* _filename, const VideoCaptureParameters&
             read_timeout = params.get<int>(CAP_PROP_READ_TIMEOUT_MSEC);
         }
 #endif
+        if (params.has(CAP_PROP_PROBE_SIZE)) {
+            probe_size = params.get<int>(CAP_PROP_PROBE_SIZE);
+        }
+        if (params.has(CAP_PROP_ANALYZE_DURATION_USEC)) {
+            analyze_duration = params.get<int>(CAP_PROP_ANALYZE_DURATION_USEC);
+        }
+        if (params.has(CAP_PROP_TRUST_CONTAINER_HEADER)) {
+            trust_container_header = params.get<bool>(CAP_PROP_TRUST_CONTAINER_HEADER);
+        }
+        if (params.has(CAP_PROP_OUTPUT_HUGE_PAGES)) {
+            output_huge_pages = params.get<bool>(CAP_PROP_OUTPUT_HUGE_PAGES);
+        }
+        if (params.has(CAP_PROP_DECODER_THREADS)) {
+            decoder_threads = params.get<int>(CAP_PROP_DECODER_THREADS);
+        }
         if (params.warnUnusedParameters()) {
             CV_LOG_ERROR(NULL, "VIDEOIO/FFMPEG: unsupported parameters in .open(), see logger INFO channel for details. Bailout");
             return false;
         }
     }
+    frame_allocator = params.getFrameAllocator();
+    return true;
+}
 
+int CvCapture_FFMPEG::openInput(const char* _filename, const VideoCaptureParameters& params) {
 #if USE_AV_INTERRUPT_CALLBACK
     /* interrupt callback */
+    interrupt_metadata.abort_request = params.getInterruptFlag();
     interrupt_metadata.timeout_after_ms = open_timeout;
     get_monotonic_time(&interrupt_metadata.value);
 
@@ -828,23 +1250,56 @@ bool CvCapture_FFMPEG::open(const char* _filename, const VideoCaptureParameters&
 #else
     av_dict_set(&dict, "rtsp_transport", "tcp", 0);
 #endif
+    for (const auto& option : params.getOptions()) {
+        av_dict_set(&dict, option.first.c_str(), option.second.c_str(), 0);
+    }
+    // smaller limits let files with well-formed headers open without reading megabytes of payload
+    if (probe_size > 0) av_dict_set_int(&dict, "probesize", probe_size, 0);
+    if (analyze_duration > 0) av_dict_set_int(&dict, "analyzeduration", analyze_duration, 0);
+
     AVInputFormat* input_format = NULL;
     AVDictionaryEntry* entry = av_dict_get(dict, "input_format", NULL, 0);
     if (entry != 0) {
         input_format = av_find_input_format(entry->value);
     }
 
-    int err = avformat_open_input(&ic, _filename, input_format, &dict);
+    return avformat_open_input(&ic, _filename, input_format, &dict);
+}
+
+bool CvCapture_FFMPEG::open(const char* _filename, const VideoCaptureParameters& params) {
+    InternalFFMpegRegister::init(_filename);
+
+    AutoLock lock(_mutex);
+
+    unsigned i;
+    bool valid = false;
+
+    close();
+
+    if (!applyParameters(_filename, params)) return false;
+
+    int err = openInput(_filename, params);
 
     if (err < 0) {
         CV_LOG_WARN(NULL, "Error opening file");
         CV_LOG_WARN(NULL, _filename);
         goto exit_func;
     }
-    err = avformat_find_stream_info(ic, NULL);
-    if (err < 0) {
-        CV_LOG_WARN(NULL, "Could not find codec parameters");
-        goto exit_func;
+#if LIBAVFORMAT_BUILD >= CALC_FFMPEG_VERSION(58, 20, 100)
+    if (trust_container_header && _opencv_ffmpeg_header_describes_video(ic)) {
+        CV_LOG_DEBUG(NULL, "FFMPEG: container header describes the video stream, skipping avformat_find_stream_info");
+        // avformat_find_stream_info is what normally fills the deprecated AVStream::codec contexts
+        for (i = 0; i < ic->nb_streams; i++) {
+            avcodec_parameters_to_context(ic->streams[i]->codec, ic->streams[i]->codecpar);
+        }
+    } else
+#endif
+    {
+        err = avformat_find_stream_info(ic, NULL);
+        if (err < 0) {
+            CV_LOG_WARN(NULL, "Could not find codec parameters");
+            goto exit_func;
+        }
     }
     for (i = 0; i < ic->nb_streams; i++) {
         AVCodecContext* enc = ic->streams[i]->codec;
@@ -852,7 +1307,7 @@ bool CvCapture_FFMPEG::open(const char* _filename, const VideoCaptureParameters&
         //#ifdef FF_API_THREAD_INIT
         //        avcodec_thread_init(enc, get_number_of_cpus());
         //#else
-        enc->thread_count = get_number_of_cpus();
+        enc->thread_count = decoder_threads > 0 ? decoder_threads : get_number_of_cpus();
         //#endif
 
         AVDictionaryEntry* avdiscard_entry = av_dict_get(dict, "avdiscard", NULL, 0);
@@ -882,9 +1337,23 @@ bool CvCapture_FFMPEG::open(const char* _filename, const VideoCaptureParameters&
         if (AVMEDIA_TYPE_VIDEO == enc->codec_type && video_stream < 0) {
             CV_LOG_DEBUG(NULL, "FFMPEG: stream[" << i << "] is video stream with codecID=" << (int)enc->codec_id << " width=" << enc->width << " height=" << enc->height);
 
+#if USE_AV_DECODER_POOL
+            // decode on a context of our own, so that close() can hand it over to the decoder pool
+            context = avcodec_alloc_context3(NULL);
+            if (!context || avcodec_parameters_to_context(context, ic->streams[i]->codecpar) < 0) {
+                CV_LOG_ERROR(NULL, "VIDEOIO/FFMPEG: Failed to allocate decoder context");
+                goto exit_func;
+            }
+            context->pkt_timebase = ic->streams[i]->time_base;
+            context->thread_count = enc->thread_count;
+            context->skip_frame = enc->skip_frame;
+#else
+            context = enc;
+#endif
+
             // backup encoder' width/height
-            int enc_width = enc->width;
-            int enc_height = enc->height;
+            int enc_width = context->width;
+            int enc_height = context->height;
 
 #if !USE_AV_HW_CODECS
             va_type = VIDEO_ACCELERATION_NONE;
@@ -902,18 +1371,18 @@ bool CvCapture_FFMPEG::open(const char* _filename, const VideoCaptureParameters&
 #if USE_AV_HW_CODECS
                 accel_iter.parse_next();
                 AVHWDeviceType hw_type = accel_iter.hw_type();
-                enc->get_format = avcodec_default_get_format;
-                if (enc->hw_device_ctx) {
-                    av_buffer_unref(&enc->hw_device_ctx);
+                context->get_format = avcodec_default_get_format;
+                if (context->hw_device_ctx) {
+                    av_buffer_unref(&context->hw_device_ctx);
                 }
                 if (hw_type != AV_HWDEVICE_TYPE_NONE) {
                     CV_LOG_DEBUG(NULL, "FFMPEG: trying to configure H/W acceleration: '" << accel_iter.hw_type_device_string() << "'");
                     AVPixelFormat hw_pix_fmt = AV_PIX_FMT_NONE;
-                    codec = hw_find_codec(enc->codec_id, hw_type, av_codec_is_decoder, accel_iter.disabled_codecs().c_str(), &hw_pix_fmt);
+                    codec = hw_find_codec(context->codec_id, hw_type, av_codec_is_decoder, accel_iter.disabled_codecs().c_str(), &hw_pix_fmt);
                     if (codec) {
-                        if (hw_pix_fmt != AV_PIX_FMT_NONE) enc->get_format = hw_get_format_callback;  // set callback to select HW pixel format, not SW format
-                        enc->hw_device_ctx = hw_create_device(hw_type, hw_device, accel_iter.device_subname(), use_opencl != 0);
-                        if (!enc->hw_device_ctx) {
+                        if (hw_pix_fmt != AV_PIX_FMT_NONE) context->get_format = hw_get_format_callback;  // set callback to select HW pixel format, not SW format
+                        context->hw_device_ctx = hw_create_device(hw_type, hw_device, accel_iter.device_subname(), use_opencl != 0);
+                        if (!context->hw_device_ctx) {
                             CV_LOG_DEBUG(NULL, "FFMPEG: ... can't create H/W device: '" << accel_iter.hw_type_device_string() << "'");
                             codec = NULL;
                         }
@@ -923,9 +1392,9 @@ bool CvCapture_FFMPEG::open(const char* _filename, const VideoCaptureParameters&
                 {
                     AVDictionaryEntry* video_codec_param = av_dict_get(dict, "video_codec", NULL, 0);
                     if (video_codec_param == NULL) {
-                        codec = avcodec_find_decoder(enc->codec_id);
+                        codec = avcodec_find_decoder(context->codec_id);
                         if (!codec) {
-                            CV_LOG_ERROR(NULL, "Could not find decoder for codec_id=" << (int)enc->codec_id);
+                            CV_LOG_ERROR(NULL, "Could not find decoder for codec_id=" << (int)context->codec_id);
                         }
                     } else {
                         CV_LOG_DEBUG(NULL, "FFMPEG: Using video_codec='" << video_codec_param->value << "'");
@@ -936,8 +1405,42 @@ bool CvCapture_FFMPEG::open(const char* _filename, const VideoCaptureParameters&
                     }
                 }
                 if (!codec) continue;
-                err = avcodec_open2(enc, codec, NULL);
+                bool software = true;
+#if USE_AV_HW_CODECS
+                software = hw_type == AV_HWDEVICE_TYPE_NONE;
+#endif
+#if USE_AV_FRAME_ALLOCATOR
+                context->opaque = NULL;
+                context->get_buffer2 = avcodec_default_get_buffer2;
+                if (software && frame_allocator) {
+                    if (codec->capabilities & AV_CODEC_CAP_DR1) {
+                        context->opaque = frame_allocator;
+                        context->get_buffer2 = _opencv_ffmpeg_frame_allocator_get_buffer2;
+                    } else {
+                        CV_LOG_INFO(NULL, "VIDEOIO/FFMPEG: decoder '" << codec->name << "' does not support direct rendering, the frame allocator is not used");
+                    }
+                }
+#endif
+                bool reused = false;
+#if USE_AV_DECODER_POOL
+                // a decoder rendering into application memory stays with this capture
+                bool poolable = software && !frame_allocator;
+                if (poolable) {
+                    decoder_key = DecoderPoolKey::make(codec, ic->streams[i]->codecpar, context);
+                    AVCodecContext* pooled = DecoderContextPool::instance().checkout(decoder_key);
+                    if (pooled) {
+                        avcodec_free_context(&context);
+                        context = pooled;
+                        context->pkt_timebase = ic->streams[i]->time_base;
+                        reused = true;
+                    }
+                }
+#endif
+                err = reused ? 0 : avcodec_open2(context, codec, NULL);
                 if (err >= 0) {
+#if USE_AV_DECODER_POOL
+                    decoder_poolable = poolable;
+#endif
 #if USE_AV_HW_CODECS
                     va_type = hw_type_to_va_type(hw_type);
                     if (hw_type != AV_HWDEVICE_TYPE_NONE && hw_device < 0) hw_device = 0;
@@ -957,19 +1460,20 @@ bool CvCapture_FFMPEG::open(const char* _filename, const VideoCaptureParameters&
             }
 
             // checking width/height (since decoder can sometimes alter it, eg. vp6f)
-            if (enc_width && (enc->width != enc_width)) enc->width = enc_width;
-            if (enc_height && (enc->height != enc_height)) enc->height = enc_height;
+            if (enc_width && (context->width != enc_width)) context->width = enc_width;
+            if (enc_height && (context->height != enc_height)) context->height = enc_height;
 
             video_stream = i;
             video_st = ic->streams[i];
+            skip_frame_base = context->skip_frame;
 #if LIBAVCODEC_BUILD >= (LIBAVCODEC_VERSION_MICRO >= 100 ? CALC_FFMPEG_VERSION(55, 45, 101) : CALC_FFMPEG_VERSION(55, 28, 1))
             picture = av_frame_alloc();
 #else
             picture = avcodec_alloc_frame();
 #endif
 
-            frame.width = enc->width;
-            frame.height = enc->height;
+            frame.width = context->width;
+            frame.height = context->height;
             frame.cn = 3;
             frame.step = 0;
             frame.data = NULL;
@@ -991,6 +1495,61 @@ exit_func:
     return valid;
 }
 
+bool CvCapture_FFMPEG::probe(const char* _filename, const VideoCaptureParameters& params, VideoProbeResult& result) {
+    InternalFFMpegRegister::init(_filename);
+
+    // no decoder is opened while probing, so unlike open() this does not take the global lock
+    bool valid = false;
+
+    close();
+
+    if (!applyParameters(_filename, params)) return false;
+
+    int err = openInput(_filename, params);
+    if (err < 0) {
+        CV_LOG_WARN(NULL, "Error opening file");
+        CV_LOG_WARN(NULL, _filename);
+    } else {
+#if LIBAVFORMAT_BUILD >= CALC_FFMPEG_VERSION(58, 20, 100)
+        // stream analysis is only needed when the container header leaves the video stream undescribed
+        if (!_opencv_ffmpeg_header_describes_video(ic)) err = avformat_find_stream_info(ic, NULL);
+        int index = err < 0 ? -1 : av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+        if (index >= 0) {
+            AVStream* st = ic->streams[index];
+            double fps = r2d(st->avg_frame_rate);
+            if (fps < eps_zero) fps = r2d(st->r_frame_rate);
+            // live streams and some containers leave both durations AV_NOPTS_VALUE, reported as 0 (unknown)
+            double duration = 0;
+            if (ic->duration != AV_NOPTS_VALUE && ic->duration > 0)
+                duration = (double)ic->duration / (double)AV_TIME_BASE;
+            else if (st->duration != AV_NOPTS_VALUE && st->duration > 0)
+                duration = (double)st->duration * r2d(st->time_base);
+
+            result.width = st->codecpar->width;
+            result.height = st->codecpar->height;
+            result.fps = fps;
+            result.duration = duration;
+            result.frames = st->nb_frames > 0 ? st->nb_frames : duration > 0 && fps > 0 ? (int64_t)floor(duration * fps + 0.5) : 0;
+            result.bitrate = ic->bit_rate / 1000;
+            result.codec = avcodec_get_name(st->codecpar->codec_id);
+            valid = true;
+        } else {
+            CV_LOG_WARN(NULL, "Could not find a video stream");
+        }
+#else
+        CV_LOG_ERROR(NULL, "VIDEOIO/FFMPEG: probing requires AVCodecParameters support");
+#endif
+    }
+
+#if USE_AV_INTERRUPT_CALLBACK
+    // deactivate interrupt callback
+    interrupt_metadata.timeout_after_ms = 0;
+#endif
+
+    close();
+    return valid;
+}
+
 bool CvCapture_FFMPEG::setRaw() {
     if (!rawMode) {
         if (frame_number != 0) {
@@ -1010,7 +1569,7 @@ bool CvCapture_FFMPEG::processRawPacket() {
 #if LIBAVFORMAT_BUILD >= CALC_FFMPEG_VERSION(58, 20, 100)
         CV_CODEC_ID eVideoCodec = ic->streams[video_stream]->codecpar->codec_id;
 #else
-        CV_CODEC_ID eVideoCodec = video_st->codec->codec_id;
+        CV_CODEC_ID eVideoCodec = context->codec_id;
 #endif
         const char* filterName = NULL;
         if (eVideoCodec == CV_CODEC(CODEC_ID_H264)
@@ -1081,6 +1640,8 @@ bool CvCapture_FFMPEG::processRawPacket() {
     return packet.data != NULL;
 }
 
+static inline int64_t _opencv_ffmpeg_picture_pts(const AVFrame* picture) { return picture->pkt_pts != AV_NOPTS_VALUE_ && picture->pkt_pts != 0 ? picture->pkt_pts : picture->pkt_dts; }
+
 bool CvCapture_FFMPEG::grabFrame() {
     bool valid = false;
 
@@ -1089,6 +1650,12 @@ bool CvCapture_FFMPEG::grabFrame() {
 
     if (!ic || !video_st) return false;
 
+    // a frame decoded ahead by grabFrameAt() is the next one in line
+    if (sample_next_valid) {
+        promoteSampleFrame();
+        return true;
+    }
+
     if (ic->streams[video_stream]->nb_frames > 0 && frame_number > ic->streams[video_stream]->nb_frames) return false;
 
     picture_pts = AV_NOPTS_VALUE_;
@@ -1101,7 +1668,11 @@ bool CvCapture_FFMPEG::grabFrame() {
 
 #if USE_AV_SEND_FRAME_API
     // check if we can receive frame from previously decoded packet
-    valid = avcodec_receive_frame(video_st->codec, picture) >= 0;
+    valid = avcodec_receive_frame(context, picture) >= 0;
+    if (valid) {
+        picture_pts = _opencv_ffmpeg_picture_pts(picture);
+        stats.framesDecoded++;
+    }
 #endif
 
     // get the next frame
@@ -1115,7 +1686,13 @@ bool CvCapture_FFMPEG::grabFrame() {
         }
 #endif
 
+        int64_t demux_start = _opencv_ffmpeg_now_ns();
         int ret = av_read_frame(ic, &packet);
+        _opencv_ffmpeg_record_latency(stats.demux, demux_start, "read_packet", frame_number);
+        if (ret >= 0) {
+            stats.packetsRead++;
+            stats.bytesRead += packet.size;
+        }
 
         if (ret == AVERROR(EAGAIN)) continue;
 
@@ -1130,6 +1707,7 @@ bool CvCapture_FFMPEG::grabFrame() {
 
         if (packet.stream_index != video_stream) {
             _opencv_ffmpeg_av_packet_unref(&packet);
+            stats.packetsSkipped++;
             count_errs++;
             if (count_errs > max_number_of_attempts) break;
             continue;
@@ -1142,23 +1720,35 @@ bool CvCapture_FFMPEG::grabFrame() {
 
         // Decode video frame
 #if USE_AV_SEND_FRAME_API
-        if (avcodec_send_packet(video_st->codec, &packet) < 0) {
+        if (sample_skipping) {
+            // a frame ending before the sampling point is never shown, the decoder may drop it unless other frames reference it
+            bool hidden = packet.data && packet.pts != AV_NOPTS_VALUE_ && dts_to_sec(packet.pts) + sample_frame_duration <= sample_skip_until;
+            context->skip_frame = hidden ? std::max(skip_frame_base, AVDISCARD_NONREF) : skip_frame_base;
+        }
+        int64_t decode_start = _opencv_ffmpeg_now_ns();
+        if (avcodec_send_packet(context, &packet) < 0) {
+            stats.decodeErrors++;
             break;
         }
-        ret = avcodec_receive_frame(video_st->codec, picture);
+        ret = avcodec_receive_frame(context, picture);
 #else
+        int64_t decode_start = _opencv_ffmpeg_now_ns();
         int got_picture = 0;
-        avcodec_decode_video2(video_st->codec, picture, &got_picture, &packet);
+        avcodec_decode_video2(context, picture, &got_picture, &packet);
         ret = got_picture ? 0 : -1;
 #endif
+        _opencv_ffmpeg_record_latency(stats.decode, decode_start, "decode", frame_number);
         if (ret >= 0) {
+            stats.framesDecoded++;
             // picture_pts = picture->best_effort_timestamp;
-            if (picture_pts == AV_NOPTS_VALUE_) picture_pts = picture->pkt_pts != AV_NOPTS_VALUE_ && picture->pkt_pts != 0 ? picture->pkt_pts : picture->pkt_dts;
+            if (picture_pts == AV_NOPTS_VALUE_) picture_pts = _opencv_ffmpeg_picture_pts(picture);
 
             valid = true;
         } else if (ret == AVERROR(EAGAIN)) {
+            stats.decodeRetries++;
             continue;
         } else {
+            stats.decodeErrors++;
             count_errs++;
             if (count_errs > max_number_of_attempts) break;
         }
@@ -1196,8 +1786,12 @@ bool CvCapture_FFMPEG::retrieveFrame(int, unsigned char** data, int* step, int*
     if (picture && picture->hw_frames_ctx) {
         sw_picture = av_frame_alloc();
         // if (av_hwframe_map(sw_picture, picture, AV_HWFRAME_MAP_READ) < 0) {
-        if (av_hwframe_transfer_data(sw_picture, picture, 0) < 0) {
+        int64_t copy_start = _opencv_ffmpeg_now_ns();
+        int copied = av_hwframe_transfer_data(sw_picture, picture, 0);
+        _opencv_ffmpeg_record_latency(stats.copy, copy_start, "download", frame_number);
+        if (copied < 0) {
             CV_LOG_ERROR(NULL, "Error copying data from GPU to CPU (av_hwframe_transfer_data)");
+            av_frame_free(&sw_picture);
             return false;
         }
     }
@@ -1205,18 +1799,33 @@ bool CvCapture_FFMPEG::retrieveFrame(int, unsigned char** data, int* step, int*
 
     if (!sw_picture || !sw_picture->data[0]) return false;
 
-    if (img_convert_ctx == NULL || frame.width != video_st->codec->width || frame.height != video_st->codec->height || frame.data == NULL) {
+    AVPixelFormat target_format = rgb ? AV_PIX_FMT_RGB24 : AV_PIX_FMT_BGR24;
+    if (img_convert_ctx == NULL || frame.width != context->width || frame.height != context->height || frame.data == NULL || output_format != target_format) {
         // Some sws_scale optimizations have some assumptions about alignment of data/step/width/height
         // Also we use coded_width/height to workaround problem with legacy ffmpeg versions (like n0.8)
-        int buffer_width = video_st->codec->coded_width, buffer_height = video_st->codec->coded_height;
+        int buffer_width = context->coded_width, buffer_height = context->coded_height;
 
-        img_convert_ctx = sws_getCachedContext(img_convert_ctx, buffer_width, buffer_height, (AVPixelFormat)sw_picture->format, buffer_width, buffer_height, rgb ? AV_PIX_FMT_RGB24 : AV_PIX_FMT_BGR24, SWS_BICUBIC, NULL, NULL, NULL);
+        img_convert_ctx = sws_getCachedContext(img_convert_ctx, buffer_width, buffer_height, (AVPixelFormat)sw_picture->format, buffer_width, buffer_height, target_format, SWS_BICUBIC, NULL, NULL, NULL);
 
         if (img_convert_ctx == NULL) return false;  // CV_Error(0, "Cannot initialize the conversion context!");
 
-#if USE_AV_FRAME_GET_BUFFER
+#if USE_AV_OUTPUT_POOL
+        // rows are padded to the alignment, the pool is only recreated when the frame size changes
+        int linesize = FFALIGN(buffer_width * 3, OUTPUT_BUFFER_ALIGN);
+        int size = linesize * buffer_height;
+        if (!output_pool || output_pool_size != size) {
+            av_buffer_pool_uninit(&output_pool);
+            output_pool = av_buffer_pool_init2(size, output_huge_pages ? (void*)&output_huge_pages : NULL, _opencv_ffmpeg_output_buffer_alloc, NULL);
+            if (!output_pool) {
+                CV_LOG_WARN(NULL, "OutOfMemory");
+                return false;
+            }
+            output_pool_size = size;
+        }
+        frame.step = linesize;
+#elif USE_AV_FRAME_GET_BUFFER
         av_frame_unref(&rgb_picture);
-        rgb_picture.format = rgb ? AV_PIX_FMT_RGB24 : AV_PIX_FMT_BGR24;
+        rgb_picture.format = target_format;
         rgb_picture.width = buffer_width;
         rgb_picture.height = buffer_height;
         if (0 != av_frame_get_buffer(&rgb_picture, 1)) {
@@ -1225,18 +1834,40 @@ bool CvCapture_FFMPEG::retrieveFrame(int, unsigned char** data, int* step, int*
         }
 #else
         int aligns[AV_NUM_DATA_POINTERS];
-        avcodec_align_dimensions2(video_st->codec, &buffer_width, &buffer_height, aligns);
+        avcodec_align_dimensions2(context, &buffer_width, &buffer_height, aligns);
         rgb_picture.data[0] = (uint8_t*)realloc(rgb_picture.data[0], _opencv_ffmpeg_av_image_get_buffer_size(AV_PIX_FMT_BGR24, buffer_width, buffer_height));
         _opencv_ffmpeg_av_image_fill_arrays(&rgb_picture, rgb_picture.data[0], AV_PIX_FMT_BGR24, buffer_width, buffer_height);
 #endif
-        frame.width = video_st->codec->width;
-        frame.height = video_st->codec->height;
+        output_format = target_format;
+        frame.width = context->width;
+        frame.height = context->height;
         frame.cn = 3;
+#if !USE_AV_OUTPUT_POOL
         frame.data = rgb_picture.data[0];
         frame.step = rgb_picture.linesize[0];
+#endif
+    }
+
+#if USE_AV_OUTPUT_POOL
+    // every frame gets its own buffer: the ones still held by the application are left untouched,
+    // released ones are handed out again without allocating
+    av_frame_unref(&rgb_picture);
+    rgb_picture.buf[0] = av_buffer_pool_get(output_pool);
+    if (!rgb_picture.buf[0]) {
+        CV_LOG_WARN(NULL, "OutOfMemory");
+        return false;
     }
+    rgb_picture.format = output_format;
+    rgb_picture.width = context->coded_width;
+    rgb_picture.height = context->coded_height;
+    rgb_picture.data[0] = rgb_picture.buf[0]->data;
+    rgb_picture.linesize[0] = frame.step;
+    frame.data = rgb_picture.data[0];
+#endif
 
-    sws_scale(img_convert_ctx, sw_picture->data, sw_picture->linesize, 0, video_st->codec->coded_height, rgb_picture.data, rgb_picture.linesize);
+    int64_t convert_start = _opencv_ffmpeg_now_ns();
+    sws_scale(img_convert_ctx, sw_picture->data, sw_picture->linesize, 0, context->coded_height, rgb_picture.data, rgb_picture.linesize);
+    _opencv_ffmpeg_record_latency(stats.convert, convert_start, "convert", frame_number);
 
     *data = frame.data;
     *step = frame.step;
@@ -1246,12 +1877,94 @@ bool CvCapture_FFMPEG::retrieveFrame(int, unsigned char** data, int* step, int*
 
 #if USE_AV_HW_CODECS
     if (sw_picture != picture) {
-        av_frame_unref(sw_picture);
+        av_frame_free(&sw_picture);
     }
 #endif
     return true;
 }
 
+// Converts the last decoded picture straight into the caller's rows, at display size and without the intermediate rgb_picture.
+// Pictures with rotation metadata are converted at coded size first and then turned, so dst always has the
+// size reported by CAP_PROP_FRAME_WIDTH / CAP_PROP_FRAME_HEIGHT.
+bool CvCapture_FFMPEG::retrieveFrameInto(unsigned char* dst, int dst_step, AVPixelFormat dst_format) {
+    if (!video_st || rawMode || !dst) return false;
+
+    AVFrame* sw_picture = picture;
+#if USE_AV_HW_CODECS
+    if (picture && picture->hw_frames_ctx) {
+        sw_picture = av_frame_alloc();
+        int64_t copy_start = _opencv_ffmpeg_now_ns();
+        int copied = av_hwframe_transfer_data(sw_picture, picture, 0);
+        _opencv_ffmpeg_record_latency(stats.copy, copy_start, "download", frame_number);
+        if (copied < 0) {
+            CV_LOG_ERROR(NULL, "Error copying data from GPU to CPU (av_hwframe_transfer_data)");
+            av_frame_free(&sw_picture);
+            return false;
+        }
+    }
+#endif
+
+    bool valid = false;
+    if (sw_picture && sw_picture->data[0]) {
+        // the destination is sized from the reported frame size, never read more rows than the picture has
+        int width = std::min(frame.width, sw_picture->width), height = std::min(frame.height, sw_picture->height);
+        int angle = display_rotation();
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(dst_format);
+        int bpp = desc ? av_get_bits_per_pixel(desc) / 8 : 0;
+        uint8_t* target = dst;
+        int target_step = dst_step;
+        if (angle) {
+            target_step = width * bpp;
+            av_fast_malloc(&rotate_buffer, &rotate_buffer_size, (size_t)target_step * height);
+            target = rotate_buffer;
+        }
+        dst_convert_ctx = sws_getCachedContext(dst_convert_ctx, width, height, (AVPixelFormat)sw_picture->format, width, height, dst_format, SWS_BICUBIC, NULL, NULL, NULL);
+        if (dst_convert_ctx && bpp && target) {
+            uint8_t* dst_data[4] = {target, NULL, NULL, NULL};
+            int dst_linesize[4] = {target_step, 0, 0, 0};
+            int64_t convert_start = _opencv_ffmpeg_now_ns();
+            valid = sws_scale(dst_convert_ctx, sw_picture->data, sw_picture->linesize, 0, height, dst_data, dst_linesize) > 0;
+            if (valid && angle) _opencv_ffmpeg_rotate_packed(target, target_step, width, height, bpp, dst, dst_step, angle);
+            _opencv_ffmpeg_record_latency(stats.convert, convert_start, "convert", frame_number);
+        }
+    }
+
+#if USE_AV_HW_CODECS
+    if (sw_picture != picture) {
+        av_frame_free(&sw_picture);
+    }
+#endif
+    return valid;
+}
+
+AVBufferRef* CvCapture_FFMPEG::refOutputBuffer() {
+#if USE_AV_OUTPUT_POOL
+    if (!rawMode && rgb_picture.buf[0]) return av_buffer_ref(rgb_picture.buf[0]);
+#endif
+    // without the pool the output buffer is overwritten by the next retrieveFrame()
+    return NULL;
+}
+
+AVFrame* CvCapture_FFMPEG::refDecodedFrame() {
+    if (!video_st || rawMode || !picture || !picture->data[0]) return NULL;
+#if USE_AV_HW_CODECS
+    if (picture->hw_frames_ctx) {
+        AVFrame* sw_picture = av_frame_alloc();
+        if (!sw_picture) return NULL;
+        int64_t copy_start = _opencv_ffmpeg_now_ns();
+        int copied = av_hwframe_transfer_data(sw_picture, picture, 0);
+        _opencv_ffmpeg_record_latency(stats.copy, copy_start, "download", frame_number);
+        if (copied < 0) {
+            CV_LOG_ERROR(NULL, "Error copying data from GPU to CPU (av_hwframe_transfer_data)");
+            av_frame_free(&sw_picture);
+            return NULL;
+        }
+        return sw_picture;
+    }
+#endif
+    return av_frame_clone(picture);
+}
+
 double CvCapture_FFMPEG::getProperty(int property_id) const {
     if (!video_st) return 0;
 
@@ -1268,12 +1981,12 @@ double CvCapture_FFMPEG::getProperty(int property_id) const {
         case CAP_PROP_POS_FRAMES: return (double)frame_number;
         case CAP_PROP_POS_AVI_RATIO: return r2d(ic->streams[video_stream]->time_base);
         case CAP_PROP_FRAME_COUNT: return (double)get_total_frames();
-        case CAP_PROP_FRAME_WIDTH: return (double)((rotation_auto && ((rotation_angle % 180) != 0)) ? frame.height : frame.width);
-        case CAP_PROP_FRAME_HEIGHT: return (double)((rotation_auto && ((rotation_angle % 180) != 0)) ? frame.width : frame.height);
+        case CAP_PROP_FRAME_WIDTH: return (double)((display_rotation() % 180) != 0 ? frame.height : frame.width);
+        case CAP_PROP_FRAME_HEIGHT: return (double)((display_rotation() % 180) != 0 ? frame.width : frame.height);
         case CAP_PROP_FPS: return get_fps();
         case CAP_PROP_FOURCC:
-            codec_id = video_st->codec->codec_id;
-            codec_tag = (double)video_st->codec->codec_tag;
+            codec_id = context->codec_id;
+            codec_tag = (double)context->codec_tag;
 
             if (codec_tag || codec_id == AV_CODEC_ID_NONE) {
                 return codec_tag;
@@ -1288,7 +2001,7 @@ double CvCapture_FFMPEG::getProperty(int property_id) const {
         case CAP_PROP_SAR_NUM: return _opencv_ffmpeg_get_sample_aspect_ratio(ic->streams[video_stream]).num;
         case CAP_PROP_SAR_DEN: return _opencv_ffmpeg_get_sample_aspect_ratio(ic->streams[video_stream]).den;
         case CAP_PROP_CODEC_PIXEL_FORMAT: {
-            AVPixelFormat pix_fmt = video_st->codec->pix_fmt;
+            AVPixelFormat pix_fmt = context->pix_fmt;
             unsigned int fourcc_tag = avcodec_pix_fmt_to_codec_tag(pix_fmt);
             return (fourcc_tag == 0) ? (double)-1 : (double)fourcc_tag;
         }
@@ -1374,10 +2087,27 @@ void CvCapture_FFMPEG::get_rotation_angle() {
 #endif
 }
 
+int CvCapture_FFMPEG::display_rotation() const {
+    if (!rotation_auto) return 0;
+    int angle = (rotation_angle % 360 + 360) % 360;
+    return angle == 90 || angle == 180 || angle == 270 ? angle : 0;
+}
+
 void CvCapture_FFMPEG::seek(int64_t _frame_number) {
+    int64_t seek_start = _opencv_ffmpeg_now_ns();
+    stats.seeks++;
+    seekFrame_(_frame_number);
+    _opencv_ffmpeg_record_latency(stats.seek, seek_start, "seek", frame_number);
+}
+
+void CvCapture_FFMPEG::seekFrame_(int64_t _frame_number) {
     _frame_number = std::min(_frame_number, get_total_frames());
     int delta = 16;
 
+    // the frame decoded ahead belongs to the old position
+    if (sample_next) av_frame_unref(sample_next);
+    sample_next_valid = false;
+
     // if we have not grabbed a single frame before first seek, let's read the first frame
     // and get some valuable information during the process
     if (first_frame_number < 0 && get_total_frames() > 1) grabFrame();
@@ -1389,7 +2119,7 @@ void CvCapture_FFMPEG::seek(int64_t _frame_number) {
         double time_base = r2d(ic->streams[video_stream]->time_base);
         time_stamp += (int64_t)(sec / time_base + 0.5);
         if (get_total_frames() > 1) av_seek_frame(ic, video_stream, time_stamp, AVSEEK_FLAG_BACKWARD);
-        avcodec_flush_buffers(ic->streams[video_stream]->codec);
+        avcodec_flush_buffers(context);
         if (_frame_number > 0) {
             grabFrame();
 
@@ -1421,6 +2151,133 @@ void CvCapture_FFMPEG::seek(int64_t _frame_number) {
 
 void CvCapture_FFMPEG::seek(double sec) { seek((int64_t)(sec * get_fps() + 0.5)); }
 
+// Start timestamps (stream time base) of about `count` segments that can be decoded independently. Intra-only
+// codecs are split evenly since every frame is a keyframe, other codecs at keyframes found by a demux-only pass.
+bool CvCapture_FFMPEG::getSegments(int count, std::vector<int64_t>& starts) {
+    starts.clear();
+    if (!ic || !video_st || rawMode || count <= 0) return false;
+
+    AVStream* st = ic->streams[video_stream];
+    int64_t start_time = st->start_time != AV_NOPTS_VALUE_ ? st->start_time : 0;
+    double time_base = r2d(st->time_base);
+    int64_t total_frames = get_total_frames();
+    double fps = get_fps();
+
+    const AVCodecDescriptor* desc = avcodec_descriptor_get(context->codec_id);
+    if (desc && (desc->props & AV_CODEC_PROP_INTRA_ONLY) && total_frames > 0 && fps > 0) {
+        count = (int)std::min<int64_t>(count, total_frames);
+        for (int i = 0; i < count; i++) {
+            int64_t first_frame = total_frames * i / count;
+            starts.push_back(start_time + (int64_t)(first_frame / fps / time_base + 0.5));
+        }
+        return true;
+    }
+
+    // the keyframe timestamps must be presentation times, the container index only has decoding times
+    std::vector<int64_t> keyframes;
+    av_seek_frame(ic, video_stream, start_time, AVSEEK_FLAG_BACKWARD);
+    AVPacket pkt;
+    memset(&pkt, 0, sizeof(pkt));
+    av_init_packet(&pkt);
+    while (av_read_frame(ic, &pkt) >= 0) {
+        if (pkt.stream_index == video_stream && (pkt.flags & AV_PKT_FLAG_KEY) && pkt.pts != AV_NOPTS_VALUE_) keyframes.push_back(pkt.pts);
+        _opencv_ffmpeg_av_packet_unref(&pkt);
+    }
+    std::sort(keyframes.begin(), keyframes.end());
+    keyframes.erase(std::unique(keyframes.begin(), keyframes.end()), keyframes.end());
+    if (keyframes.empty()) return false;
+
+    // merge GOPs into segments of about the same length
+    size_t segments = std::min(keyframes.size(), (size_t)count);
+    for (size_t i = 0; i < segments; i++) {
+        int64_t key = keyframes[keyframes.size() * i / segments];
+        if (starts.empty() || starts.back() != key) starts.push_back(key);
+    }
+    return true;
+}
+
+// Decodes the frames presented in [start, end) (stream time base, a negative end runs to the end of the stream) and
+// calls on_frame(frame index, seconds) for each of them, the frame is in picture for retrieveFrame(). Decoding past
+// `end` lets an open GOP finish its leading frames, the ones before `start` are discarded.
+bool CvCapture_FFMPEG::decodeSegment(int64_t start, int64_t end, const std::function<bool(int64_t, double)>& on_frame) {
+    if (!ic || !video_st || rawMode) return false;
+
+    if (sample_next) av_frame_unref(sample_next);
+    sample_next_valid = false;
+    int64_t seek_start = _opencv_ffmpeg_now_ns();
+    stats.seeks++;
+    av_seek_frame(ic, video_stream, start, AVSEEK_FLAG_BACKWARD);
+    avcodec_flush_buffers(context);
+    _opencv_ffmpeg_record_latency(stats.seek, seek_start, "seek", frame_number);
+
+    frame_number = dts_to_frame_number(start);
+    while (grabFrame()) {
+        if (picture_pts == AV_NOPTS_VALUE_ || picture_pts < start) continue;
+        if (end >= 0 && picture_pts >= end) break;
+        int64_t index = dts_to_frame_number(picture_pts);
+        frame_number = index + 1;
+        if (!on_frame(index, dts_to_sec(picture_pts))) return false;
+    }
+    return true;
+}
+
+void CvCapture_FFMPEG::promoteSampleFrame() {
+    av_frame_unref(picture);
+    av_frame_move_ref(picture, sample_next);
+    picture_pts = sample_next_pts;
+    sample_next_valid = false;
+    // frames dropped by the decoder are not counted by grabFrame(), derive the position from the timestamp
+    if (picture_pts != AV_NOPTS_VALUE_ && first_frame_number >= 0)
+        frame_number = dts_to_frame_number(picture_pts) - first_frame_number + 1;
+    else
+        frame_number++;
+}
+
+// Moves forward to the frame on screen at `sec` (stream time), like the fps filter: a frame is repeated when the
+// sampling rate is above the frame rate and dropped when below. Nothing is converted, and non-reference frames that
+// end before `sec` are not decoded. Returns false at the end of the stream.
+bool CvCapture_FFMPEG::grabFrameAt(double sec) {
+    if (!ic || !video_st || rawMode) return false;
+#if USE_AV_SEND_FRAME_API
+    if (!sample_next && !(sample_next = av_frame_alloc())) return false;
+
+    double fps = get_fps();
+    sample_frame_duration = fps > 0 ? 1.0 / fps : 0;
+    // half a frame absorbs the timestamp rounding of the container
+    double tolerance = sample_frame_duration / 2;
+
+    for (;;) {
+        if (!sample_next_valid) {
+            // decode ahead into sample_next, the frame on screen stays in picture
+            std::swap(picture, sample_next);
+            int64_t shown_pts = picture_pts, shown_frame_number = frame_number;
+            sample_skipping = true;
+            sample_skip_until = sec - tolerance;
+            sample_next_valid = grabFrame();
+            sample_skipping = false;
+            context->skip_frame = skip_frame_base;
+            sample_next_pts = picture_pts;
+            std::swap(picture, sample_next);
+            picture_pts = shown_pts;
+            frame_number = shown_frame_number;
+
+            if (!sample_next_valid) {
+                // end of stream, the last frame stays on screen for one frame duration
+                return picture->data[0] && picture_pts != AV_NOPTS_VALUE_ && dts_to_sec(picture_pts) + sample_frame_duration > sec - tolerance;
+            }
+        }
+        if (sample_next_pts == AV_NOPTS_VALUE_ || dts_to_sec(sample_next_pts) > sec + tolerance) {
+            // the next frame is shown after `sec`, so the current one is the sample
+            if (picture->data[0]) return true;
+        }
+        promoteSampleFrame();
+    }
+#else
+    seek(sec);
+    return picture_pts != AV_NOPTS_VALUE_;
+#endif
+}
+
 bool CvCapture_FFMPEG::setProperty(int property_id, double value) {
     if (!video_st) return false;
 
@@ -1501,6 +2358,16 @@ static CvCapture_FFMPEG* cvCreateFileCaptureWithParams_FFMPEG(const char* filena
     return 0;
 }
 
+static bool cvProbeFile_FFMPEG(const char* filename, const VideoCaptureParameters& params, VideoProbeResult& result) {
+    CvCapture_FFMPEG* capture = (CvCapture_FFMPEG*)malloc(sizeof(*capture));
+    if (!capture) return false;
+    capture->init();
+    bool valid = capture->probe(filename, params, result);
+    capture->close();
+    free(capture);
+    return valid;
+}
+
 void cvReleaseCapture_FFMPEG(CvCapture_FFMPEG** capture) {
     if (capture && *capture) {
         (*capture)->close();
@@ -3,6 +3,9 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <functional>
 #include "utils.h"
 
 struct IVideoCaptureFrame {
@@ -13,6 +16,36 @@ struct IVideoCaptureFrame {
     int cn;
 };
 
+// A decoded picture in its native pixel format, the buffer keeps the planes alive.
+struct IVideoCapturePlanes {
+    unsigned char* data[4] = {};
+    int step[4] = {};
+    int planes = 0;
+    int width = 0;
+    int height = 0;
+    int cn = 0;
+    VI::PixelFormat format = VI::PixelFormat::Unknown;
+    std::shared_ptr<void> buffer;
+};
+
+struct VideoProbeResult {
+    int width = 0;
+    int height = 0;
+    double fps = 0;
+    double duration = 0;
+    int64_t frames = 0;
+    int64_t bitrate = 0;
+    std::string codec;
+};
+
+struct DecoderPoolCounters {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t idle = 0;
+    size_t capacity = 0;
+};
+
 struct CvCapture {
     virtual ~CvCapture() {}
     virtual double getProperty(int) const { return 0; }
@@ -132,6 +165,23 @@ private:
 class VideoCaptureParameters : public VideoParameters {
 public:
     using VideoParameters::VideoParameters;  // reuse constructors
+
+    // Raising the flag aborts any blocking FFmpeg I/O of the capture (open, read, seek).
+    void setInterruptFlag(const std::atomic<bool>* flag) { interrupt_ = flag; }
+    const std::atomic<bool>* getInterruptFlag() const { return interrupt_; }
+
+    // Memory for the decoded frames, owned by the application.
+    void setFrameAllocator(VI::FrameAllocator* allocator) { allocator_ = allocator; }
+    VI::FrameAllocator* getFrameAllocator() const { return allocator_; }
+
+    // String options forwarded to the FFmpeg open dictionary, e.g. "input_format" or "video_codec".
+    void addOption(const std::string& key, const std::string& value) { options_.emplace_back(key, value); }
+    const std::vector<std::pair<std::string, std::string>>& getOptions() const { return options_; }
+
+private:
+    const std::atomic<bool>* interrupt_ = nullptr;
+    VI::FrameAllocator* allocator_ = nullptr;
+    std::vector<std::pair<std::string, std::string>> options_;
 };
 
 class IVideoCapture {
@@ -144,6 +194,23 @@ public:
     virtual bool isOpened() const = 0;
     virtual void seek(int64_t frame_number) = 0;
     virtual void seek(double sec) = 0;
+    // Steps to the frame shown at sec without converting anything, see CvCapture_FFMPEG::grabFrameAt.
+    virtual bool grabFrameAt(double) { return false; }
+    // Segment-parallel decoding, see CvCapture_FFMPEG::getSegments and CvCapture_FFMPEG::decodeSegment.
+    virtual bool getSegments(int, std::vector<int64_t>&) { return false; }
+    virtual bool decodeSegment(int64_t, int64_t, const std::function<bool(int64_t, double)>&) { return false; }
+    virtual bool getStats(VI::VideoStats&) const { return false; }
+    virtual void setInterruptFlag(const std::atomic<bool>*) {}
+    // A reference keeping the pixels of the last retrieved frame alive, empty if frames are not refcounted.
+    virtual std::shared_ptr<void> refFrameBuffer() { return nullptr; }
+    // The last decoded picture before conversion.
+    virtual bool retrieveDecoded(IVideoCapturePlanes&) { return false; }
+    // Converts the last decoded picture into caller memory, packed formats only.
+    virtual bool retrieveFrameInto(unsigned char*, int, VI::PixelFormat) { return false; }
 };
 
 IVideoCapture* cvCreateFileCapture_FFMPEG_proxy(const std::string& filename, const VideoCaptureParameters& params);
+// Reads the container header (and only if needed the stream info), no decoder is opened.
+bool cvProbeFile_FFMPEG_proxy(const std::string& filename, const VideoCaptureParameters& params, VideoProbeResult& result);
+void cvSetDecoderPoolCapacity_FFMPEG_proxy(size_t capacity);
+DecoderPoolCounters cvGetDecoderPoolStats_FFMPEG_proxy();
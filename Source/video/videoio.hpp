@@ -73,8 +73,15 @@ enum VideoCaptureProperties {
     CAP_PROP_AUDIO_TOTAL_STREAMS = 65,       //!< (read-only) Number of audio streams.
     CAP_PROP_AUDIO_SYNCHRONIZE = 66,         //!< (open, read) Enables audio synchronization.
 #ifndef CV_DOXYGEN
-    CV__CAP_PROP_LATEST
+    CV__CAP_PROP_LATEST,
 #endif
+
+    // VI extensions, kept apart from the OpenCV numbering
+    CAP_PROP_PROBE_SIZE = 1024,               //!< (**open-only**) Maximum bytes read by avformat_find_stream_info, 0 keeps the FFmpeg default.
+    CAP_PROP_ANALYZE_DURATION_USEC = 1025,    //!< (**open-only**) Maximum stream duration in microseconds analyzed by avformat_find_stream_info, 0 keeps the FFmpeg default.
+    CAP_PROP_TRUST_CONTAINER_HEADER = 1026,   //!< (**open-only**) If non-zero, skip avformat_find_stream_info when the container header fully describes the video stream.
+    CAP_PROP_OUTPUT_HUGE_PAGES = 1027,        //!< (**open-only**) If non-zero, back the converted output frames with transparent huge pages (Linux only).
+    CAP_PROP_DECODER_THREADS = 1028,          //!< (**open-only**) Number of decoder threads, 0 uses one per core.
 };
 
 enum VideoAccelerationType {
@@ -13,7 +13,7 @@ int main(int argc, char* argv[]) {
     int texWidth = 0;
     int texHeight = 0;
     if (type == "--camera") {
-        auto devices = VI::Camera::getDeviceList();
+        auto devices = VI::Camera::getDevices();
         camera = std::make_shared<VI::Camera>(0, 1920, 1080, 0);
         camera->showSettingsWindow();
         texWidth = camera->getWidth();